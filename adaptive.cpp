@@ -0,0 +1,180 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <future>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "simdNorm.hpp"
+#include "sphere.hpp"
+#include "sphereTables.hpp"
+#include "adaptive.hpp"
+
+static GLuint64 edgeKey(GLuint a, GLuint b)
+{
+    return a < b ? (GLuint64(a) << 32) | b : (GLuint64(b) << 32) | a;
+}
+
+adaptiveSphere::adaptiveSphere(GLuint maxOrder, const predicate &refine):maxOrder(std::min(maxOrder, sphere::maxn))
+{
+    // start from the order 0 sphere so the corners and winding are the builder's
+    const auto baseVerts = sphereTables::GetVerts(0);
+    verts.assign(baseVerts.begin(), baseVerts.end());
+    const auto baseInds = sphereTables::GetInds(0);
+    for(std::size_t i=0; i<baseInds.size(); i+=3)
+        tree.push_back({{baseInds[i], baseInds[i + 1], baseInds[i + 2]}, 0, 0});
+
+    // step 1: split wherever the predicate asks, children are appended so
+    // the loop reaches them too
+    for(GLuint t=0; t<tree.size(); ++t){
+        const node &nd = tree[t];
+        if(nd.order < maxOrder && refine(&verts[3 * nd.v[0]], &verts[3 * nd.v[1]], &verts[3 * nd.v[2]], nd.order))
+            split(t);
+    }
+    // step 2: split any leaf with a neighbour two or more levels finer,
+    // each split can unbalance a coarser neighbour so repeat until none do
+    for(bool changed=true; changed; ){
+        changed = false;
+        for(GLuint t=0; t<tree.size(); ++t){
+            if(tree[t].child == 0 && unbalanced(t)){
+                split(t);
+                changed = true;
+            }
+        }
+    }
+    // step 3: the leaves, with transition triangles where a neighbour is finer
+    leaves.assign(maxOrder + 1, 0);
+    for(GLuint t=0; t<tree.size(); ++t) if(tree[t].child == 0) emit(t);
+    std::vector<node>().swap(tree);
+    mids.clear();
+}
+
+// four children as sphereObj makes them, three at the corners and one in the centre
+void adaptiveSphere::split(GLuint t)
+{
+    const GLuint a = tree[t].v[0], b = tree[t].v[1], c = tree[t].v[2], order = tree[t].order + 1;
+    const GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+    tree[t].child = tree.size();
+    tree.push_back({{a, ab, ca}, 0, order});
+    tree.push_back({{ab, b, bc}, 0, order});
+    tree.push_back({{ca, bc, c}, 0, order});
+    tree.push_back({{ab, bc, ca}, 0, order});
+}
+
+// the sum of the two vertices normalised, exactly as sphereObj makes it
+GLuint adaptiveSphere::midpoint(GLuint a, GLuint b)
+{
+    auto it = mids.find(edgeKey(a, b));
+    if(it != mids.end()) return it -> second;
+    const GLuint m = verts.size() / 3;
+    verts.push_back(verts[3 * a] + verts[3 * b]);
+    verts.push_back(verts[3 * a + 1] + verts[3 * b + 1]);
+    verts.push_back(verts[3 * a + 2] + verts[3 * b + 2]);
+    simdNorm::normalize(verts.data() + 3 * std::size_t(m), 1);
+    mids[edgeKey(a, b)] = m;
+    return m;
+}
+
+// the octahedron's vertices are never midpoints, so 0 can mean none
+GLuint adaptiveSphere::findMid(GLuint a, GLuint b)
+{
+    auto it = mids.find(edgeKey(a, b));
+    return it == mids.end() ? 0 : it -> second;
+}
+
+// an edge whose halves have midpoints has a neighbour two levels finer
+bool adaptiveSphere::unbalanced(GLuint t)
+{
+    const GLuint *v = tree[t].v;
+    for(GLuint j=0; j<3; ++j){
+        const GLuint a = v[j], b = v[(j + 1) % 3], m = findMid(a, b);
+        if(m && (findMid(a, m) || findMid(m, b))) return true;
+    }
+    return false;
+}
+
+// a leaf with midpoints on some of its edges, made by finer neighbours, is
+// cut to meet them, one midpoint makes two triangles, two make three and
+// all three make the usual four
+void adaptiveSphere::emit(GLuint t)
+{
+    const GLuint *v = tree[t].v;
+    GLuint m[3], n = 0, first = 0;
+    for(GLuint j=0; j<3; ++j){
+        m[j] = findMid(v[j], v[(j + 1) % 3]); // on the edge from v[j]
+        if(m[j]) ++n;
+    }
+    // the first of the run of midpoints, going round
+    for(GLuint j=0; j<3 && n < 3; ++j) if(m[j] && !m[(j + 2) % 3]) first = j;
+    ++leaves[tree[t].order];
+    auto tri = [this](GLuint a, GLuint b, GLuint c){ inds.insert(inds.end(), {a, b, c}); };
+    // turned so the midpoints start on the edge from a
+    const GLuint a = v[first], b = v[(first + 1) % 3], c = v[(first + 2) % 3];
+    const GLuint ab = m[first], bc = m[(first + 1) % 3], ca = m[(first + 2) % 3];
+    switch(n){
+        case 0:
+            tri(v[0], v[1], v[2]);
+            break;
+        case 1:
+            tri(a, ab, c);
+            tri(ab, b, c);
+            break;
+        case 2:
+            tri(ab, b, bc);
+            tri(a, ab, bc);
+            tri(a, bc, c);
+            break;
+        default:
+            tri(a, ab, ca);
+            tri(ab, b, bc);
+            tri(ca, bc, c);
+            tri(ab, bc, ca);
+    }
+}
+
+// a T-junction or a gap leaves an edge with only one triangle, the winding
+// is not checked as the builder's octahedron winds its two halves oppositely
+bool adaptiveSphere::closed()
+{
+    std::unordered_map<GLuint64, GLuint> edges;
+    for(std::size_t i=0; i<inds.size(); i+=3)
+        for(GLuint j=0; j<3; ++j) ++edges[edgeKey(inds[i + j], inds[i + (j + 1) % 3])];
+    for(auto &e: edges) if(e.second != 2) return false;
+    return true;
+}
+
+// the error of a flat triangle is how far its plane falls inside the sphere,
+// seen from the eye a radial error shows most at the silhouette and hardly at
+// all face on, so it is weighted by the sine of the angle to the line of sight.
+// Triangles wholly on the far side are never refined
+adaptiveSphere::predicate adaptiveSphere::screenError(const GLfloat eye[3], GLfloat focal, GLfloat maxErrPx)
+{
+    const std::array<GLfloat, 3> e = {eye[0], eye[1], eye[2]};
+    return [e, focal, maxErrPx](const GLfloat *a, const GLfloat *b, const GLfloat *c, GLuint){
+        auto dot = [](const GLfloat *p, const GLfloat *q){ return p[0] * q[0] + p[1] * q[1] + p[2] * q[2]; };
+        const GLfloat eyeLen = std::sqrt(dot(e.data(), e.data()));
+        const GLfloat u[] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        const GLfloat w[] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        const GLfloat chord = std::sqrt(std::max(dot(u, u), dot(w, w)));
+        // a point p of the unit sphere can be seen when p.eye > 1
+        const GLfloat facing = std::max({dot(a, e.data()), dot(b, e.data()), dot(c, e.data())});
+        if(facing < 1.0f - chord * eyeLen) return false;
+        const GLfloat n[] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0]};
+        const GLfloat err = 1.0f - std::abs(dot(n, a)) / std::sqrt(dot(n, n));
+        GLfloat dist = 1e30f, sine = 0.0f;
+        for(const GLfloat *p: {a, b, c}){
+            const GLfloat s[] = {e[0] - p[0], e[1] - p[1], e[2] - p[2]};
+            const GLfloat len = std::sqrt(dot(s, s));
+            dist = std::min(dist, len);
+            const GLfloat cosine = dot(s, p) / len;
+            sine = std::max(sine, std::sqrt(std::max(0.0f, 1.0f - cosine * cosine)));
+        }
+        return err * sine * focal / dist > maxErrPx;
+    };
+}
@@ -0,0 +1,54 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef adaptiveDec
+#define adaptiveDec
+
+// A sphere divided only where a predicate asks, up to maxOrder, which is
+// held to sphere::maxn as the builder's orders are. Triangles
+// are split into four as in sphereObj, and neighbouring triangles are kept
+// within one level of each other. The coarser side of each level boundary is
+// then cut into two or three transition triangles, meeting the finer side's
+// midpoints, so the mesh has no cracks or T-junctions.
+class adaptiveSphere
+{
+public:
+    // a, b and c are the corners, unit vectors, of a triangle of the given order
+    using predicate = std::function<bool(const GLfloat *a, const GLfloat *b, const GLfloat *c, GLuint order)>;
+
+    adaptiveSphere(GLuint maxOrder, const predicate &refine);
+    const std::vector<GLuint>& GetInds(){ return inds; }
+    const std::vector<GLfloat>& GetVerts(){ return verts; }
+    GLuint64 GetNInds(){ return inds.size(); }
+    GLuint GetMaxOrder(){ return maxOrder; }
+    GLuint levelCount(GLuint order){ return order < leaves.size() ? leaves[order] : 0; } // leaf triangles
+    bool closed(); // every edge in exactly two triangles
+
+    // refines what a camera at eye, in units of the sphere's radius, sees with
+    // more than maxErrPx pixels of error, focal is pixels over tan(half fov)
+    static predicate screenError(const GLfloat eye[3], GLfloat focal, GLfloat maxErrPx);
+private:
+    struct node
+    {
+        GLuint v[3]; // corners, wound as the builder winds them
+        GLuint child; // first of four, 0 for a leaf
+        GLuint order;
+    };
+
+    void split(GLuint t);
+    GLuint midpoint(GLuint a, GLuint b); // made when missing
+    GLuint findMid(GLuint a, GLuint b); // 0 when missing
+    bool unbalanced(GLuint t);
+    void emit(GLuint t);
+
+    // private data
+    std::vector<GLfloat> verts;
+    std::vector<GLuint> inds;
+    std::vector<node> tree; // the 8 octahedron faces come first
+    std::unordered_map<GLuint64, GLuint> mids; // edge, as its two vertices, to midpoint
+    std::vector<GLuint> leaves; // per order
+    const GLuint maxOrder;
+};
+
+#endif
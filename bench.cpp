@@ -0,0 +1,213 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+// Microbenchmarks for the sphere builder and the buffers handed to OpenGL,
+// no window or GL context is needed. Each stage is timed for every order,
+// allocations are counted and the results are written as JSON so they can
+// be compared across commits.
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <malloc.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <future>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "sphere.hpp"
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+// every operator new in the process goes through here, the sizes come from
+// the allocator so sized and unsized deletes are treated alike
+static std::atomic<GLuint64> nAlloc{0}, allocBytes{0}, liveBytes{0}, peakBytes{0};
+
+static void* counted(std::size_t n)
+{
+    void *p = std::malloc(n ? n : 1);
+    if(!p) throw std::bad_alloc();
+    const GLuint64 size = malloc_usable_size(p);
+    ++nAlloc;
+    allocBytes += size;
+    const GLuint64 live = liveBytes += size;
+    GLuint64 peak = peakBytes.load();
+    while(live > peak && !peakBytes.compare_exchange_weak(peak, live));
+    return p;
+}
+
+static void uncounted(void *p) noexcept
+{
+    if(!p) return;
+    liveBytes -= malloc_usable_size(p);
+    std::free(p);
+}
+
+void* operator new(std::size_t n) { return counted(n); }
+void* operator new[](std::size_t n) { return counted(n); }
+void operator delete(void *p) noexcept { uncounted(p); }
+void operator delete[](void *p) noexcept { uncounted(p); }
+void operator delete(void *p, std::size_t) noexcept { uncounted(p); }
+void operator delete[](void *p, std::size_t) noexcept { uncounted(p); }
+
+namespace
+{
+    struct allocs
+    {
+        GLuint64 count, bytes;
+    };
+
+    struct stage
+    {
+        std::vector<double> ms;
+        allocs mem;
+    };
+
+    struct result
+    {
+        GLuint order;
+        GLuint64 nVerts, nInds;
+        stage build, vertsNorms, inds, release;
+        GLuint64 peakHeap, peakRSS; // bytes
+    };
+}
+
+static allocs allocsNow()
+{
+    return {nAlloc.load(), allocBytes.load()};
+}
+
+// the resident set high water mark is reset so each order reports its own peak,
+// kernels without clear_refs leave it at the peak of the whole process
+static void resetPeakRSS()
+{
+    std::ofstream clear("/proc/self/clear_refs");
+    if(clear) clear << "5";
+}
+
+static GLuint64 peakRSS()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line))
+        if(line.compare(0, 6, "VmHWM:") == 0) return std::stoull(line.substr(6)) << 10;
+    return sphere::peakRSS() << 10;
+}
+
+// times one call of f, the allocations it makes are added to s
+template <class F> static void timeStage(stage &s, F f)
+{
+    const allocs a0 = allocsNow();
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    const allocs a1 = allocsNow();
+    s.ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    s.mem.count = a1.count - a0.count; // the same on every repeat
+    s.mem.bytes = a1.bytes - a0.bytes;
+}
+
+static result benchOrder(GLuint order, GLuint reps)
+{
+    result r{};
+    r.order = order;
+    resetPeakRSS();
+    const GLuint64 heap0 = liveBytes.load();
+    peakBytes = heap0;
+    for(GLuint i=0; i<reps; ++i){
+        timeStage(r.build, [&]{ sphere::build(order); });
+        timeStage(r.vertsNorms, [&]{ r.nVerts = sphere::GetVertsNorms().size() / 6; });
+        timeStage(r.inds, [&]{ r.nInds = sphere::GetInds().size(); });
+        timeStage(r.release, [&]{ sphere::release(); });
+    }
+    r.peakHeap = peakBytes.load() - heap0;
+    r.peakRSS = peakRSS();
+    return r;
+}
+
+static void writeStage(std::ostream &os, const char *name, stage s, bool last)
+{
+    std::sort(s.ms.begin(), s.ms.end());
+    double mean = 0.0;
+    for(auto t: s.ms) mean += t;
+    mean /= s.ms.size();
+    os << "        \"" << name << "\": {\"min_ms\": " << s.ms.front() << ", \"median_ms\": " << s.ms[s.ms.size() / 2]
+       << ", \"mean_ms\": " << mean << ", \"allocs\": " << s.mem.count << ", \"alloc_bytes\": " << s.mem.bytes << "}"
+       << (last ? "\n" : ",\n");
+}
+
+static void writeJson(std::ostream &os, const std::vector<result> &results, GLuint reps, GLuint threads)
+{
+    const std::string commit = BENCH_COMMIT; // empty outside a git checkout
+    os << "{\n  \"commit\": \"" << (commit.empty() ? "unknown" : commit) << "\",\n  \"repeats\": " << reps
+       << ",\n  \"threads\": " << threads << ",\n  \"orders\": [\n";
+    for(std::size_t i=0; i<results.size(); ++i){
+        const result &r = results[i];
+        os << "    {\n      \"order\": " << r.order << ", \"verts\": " << r.nVerts << ", \"inds\": " << r.nInds
+           << ",\n      \"peak_heap_bytes\": " << r.peakHeap << ", \"peak_rss_bytes\": " << r.peakRSS
+           << ",\n      \"stages\": {\n";
+        writeStage(os, "build", r.build, false);
+        writeStage(os, "verts_norms", r.vertsNorms, false);
+        writeStage(os, "inds", r.inds, false);
+        writeStage(os, "release", r.release, true);
+        os << "      }\n    }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+static int benchMain(int argc, char *argv[])
+{
+    if(argc < 2 || argc > 5){
+        std::cout << "usage: " << argv[0] << " maxOrder [repeats] [threads] [out.json]\n";
+        std::cout << "   threads of 0 is one per hardware thread, results go to bench.json by default\n";
+        return 1;
+    }
+    const GLuint maxOrder = atoi(argv[1]);
+    const GLuint reps = argc > 2 ? atoi(argv[2]) : 5;
+    const GLuint threads = argc > 3 ? atoi(argv[3]) : 1;
+    const std::string out = argc > 4 ? argv[4] : "bench.json";
+    if(reps == 0) throw std::runtime_error("Error: benchMain(), need at least one repeat");
+
+    // the builder itself is measured, not the disk or the baked tables
+    sphere::setCache(false);
+    sphere::setBaked(false);
+    sphere::setThreads(threads);
+
+    std::vector<result> results;
+    for(GLuint n=0; n<=maxOrder; ++n) results.push_back(benchOrder(n, reps));
+
+    std::printf("order      verts   build ms  v+n ms  inds ms  rel ms    allocs  peak heap MB  peak RSS MB\n");
+    for(auto &r: results){
+        auto minMs = [](const stage &s){ return *std::min_element(s.ms.begin(), s.ms.end()); };
+        std::printf("%5u %10llu %10.3f %7.3f %8.3f %7.3f %9llu %13.1f %12.1f\n", r.order, (unsigned long long) r.nVerts,
+            minMs(r.build), minMs(r.vertsNorms), minMs(r.inds), minMs(r.release),
+            (unsigned long long) (r.build.mem.count + r.vertsNorms.mem.count + r.inds.mem.count + r.release.mem.count),
+            r.peakHeap / 1048576.0, r.peakRSS / 1048576.0);
+    }
+    std::ofstream os(out);
+    if(!os) throw std::runtime_error("Error: benchMain(), cannot write " + out);
+    writeJson(os, results, reps, sphere::GetThreads());
+    std::cout << "results written to " << out << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    try{
+        return benchMain(argc, argv);
+    }
+    catch(const std::runtime_error &e){
+        std::cerr << "Runtime error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,54 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef bufViewDec
+#define bufViewDec
+
+// read only window onto a buffer owned by someone else,
+// passing one around never copies the data
+template<typename T>
+class bufView
+{
+public:
+    bufView() = default;
+    bufView(const T *p, std::size_t n):ptr(p), len(n) {}
+    bufView(const std::vector<T> &vec):ptr(vec.data()), len(vec.size()) {}
+    const T* data() const { return ptr; }
+    std::size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + len; }
+    const T& operator[](std::size_t i) const { return ptr[i]; }
+private:
+    const T *ptr = nullptr;
+    std::size_t len = 0;
+};
+
+// vertex layouts, pos is xyz only and the normal is read from the position
+// (they are the same on a unit sphere), posNorm is xyz then the normal,
+// oct16 and half are compressed directions, see vertFormat.hpp, and
+// procedural has no vertices at all, the shader makes them from gl_VertexID
+enum class vertLayout { pos, posNorm, oct16, half, procedural };
+
+// index buffer widths, automatic picks 16 bits whenever every vertex fits
+enum class indType { automatic, u16, u32 };
+
+// an index buffer of either width, along with its GL type
+class indView
+{
+public:
+    indView(bufView<GLushort> v):ptr(v.data()), len(v.size()), glType(GL_UNSIGNED_SHORT) {}
+    indView(bufView<GLuint> v):ptr(v.data()), len(v.size()), glType(GL_UNSIGNED_INT) {}
+    const void* data() const { return ptr; }
+    std::size_t size() const { return len; }
+    GLenum type() const { return glType; }
+    std::size_t elemSize() const { return glType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+    std::size_t bytes() const { return len * elemSize(); }
+private:
+    const void *ptr;
+    std::size_t len;
+    GLenum glType;
+};
+
+#endif
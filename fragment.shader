@@ -1,17 +1,13 @@
 #version 330 core
-uniform vec3 triangleColor;
-
+// triangleColor and the lights are in the frame block, see frame.shader
 in vec3 Normal;
 in vec3 FragPos;
+flat in vec3 Color;
 out vec4 outColor;
 
 void main()
 {
-    vec3 lightPos = vec3(45.0, 45.0, 80.0);
-    vec3 lightColor = vec3(0.9, 0.9, 0.9);
     float ambientStrength = 0.2;
-    
-    vec3 viewPos = vec3(0.0, 0.0, 50.0);
     float specularStrength = 0.5;
 
     
@@ -26,9 +22,8 @@ void main()
     
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * lightColor; 
-    vec3 result = (ambient + diffuse + specular) * triangleColor;
+    vec3 result = (ambient + diffuse + specular) * triangleColor * Color;
     outColor = vec4(result, 1.0);
     //outColor = vec4(triangleColor, 1.0);
 }
 
-
@@ -0,0 +1,15 @@
+// per frame state, shared by every stage and uploaded in one go, oglWrap
+// puts this after the #version line of each shader so they all agree
+layout (std140, row_major) uniform frame
+{
+    mat4 perspective;
+    mat4 rotate;
+    vec3 triangleColor;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 viewPos;
+    int sphereOrder; // for PROCEDURAL
+    float tessLevel; // for the tessellation stages, every edge's level when above 0
+    float tessPixels; // otherwise the length on screen each edge is divided down to
+    float tessScale; // pixels a unit long at unit distance covers
+};
@@ -0,0 +1,173 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <future>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <limits>
+#include "sphere.hpp"
+#include "opengl.hpp"
+#include "gpuBench.hpp"
+
+// milliseconds per draw of the current buffers, glFinish() brackets the
+// timed draws so queued work is not counted and all of ours is
+static double timeDraws(GLuint64 nInds, GLuint nDraws)
+{
+    oglWrap::draw(nInds, 0); // warm up, the driver may defer the upload
+    glFinish();
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for(GLuint i=0; i<nDraws; ++i) oglWrap::draw(nInds, 0);
+    glFinish();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count() / nDraws;
+}
+
+void gpuBench::indexTypes(GLuint order, GLuint nDraws)
+{
+    sphere::build(order);
+    const GLuint64 nInds = sphere::GetNInds();
+    const bool fits16 = sphere::GetVerts().size() / 3 <= 65536;
+    
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "index benchmark: order " << order << ", " << nInds / 3 << " triangles, " << nDraws << " draws" << std::endl;
+    for(auto type: {indType::u32, indType::u16}){
+        if(type == indType::u16 && !fits16){
+            std::cout << "  16 bit: too many vertices" << std::endl;
+            continue;
+        }
+        sphere::setIndexType(type);
+        indView inds = sphere::GetIndBuff();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        oglWrap::createBuff(sphere::GetVerts(), inds, vertLayout::pos);
+        glFinish();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        double upload = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double draw = timeDraws(nInds, nDraws);
+        std::cout << "  " << (type == indType::u16 ? "16" : "32") << " bit: index buffer " << inds.bytes() / 1024.0 << " KB";
+        std::cout << ", upload " << upload << " ms, draw " << draw << " ms" << std::endl;
+        oglWrap::deleteBuff();
+    }
+    sphere::setIndexType(indType::automatic);
+    sphere::release();
+}
+
+// the spheres fill a cube of side 2 about the origin, which the fixed
+// perspective keeps in view, coloured by where they are in it
+std::vector<oglWrap::instance> gpuBench::grid(GLuint count)
+{
+    GLuint side = 1;
+    while(GLuint64(side) * side * side < count) ++side;
+    const GLfloat spacing = 2.0f / side;
+    std::vector<oglWrap::instance> insts(count);
+    for(GLuint i=0; i<count; ++i){
+        const GLuint c[3] = {i % side, (i / side) % side, i / (side * side)};
+        auto &inst = insts[i];
+        for(int k=0; k<3; ++k){
+            inst.pos[k] = side == 1 ? 0.0f : -1.0f + spacing * (c[k] + 0.5f);
+            inst.color[k] = 0.3f + 0.7f * (c[k] + 0.5f) / side;
+        }
+        inst.scale = side == 1 ? 1.0f : 0.4f * spacing;
+    }
+    return insts;
+}
+
+// milliseconds per frame of nFrames, each frame cleared and finished
+template <class F> static double timeFrames(GLuint nFrames, F drawAll)
+{
+    drawAll(); // warm up
+    glFinish();
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for(GLuint f=0; f<nFrames; ++f){
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawAll();
+        glFinish();
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count() / nFrames;
+}
+
+void gpuBench::instances(GLuint order, GLuint maxCount, GLuint nFrames)
+{
+    sphere::build(order);
+    const GLuint64 nInds = sphere::GetNInds();
+    oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+    sphere::release();
+    oglWrap::setColor(1.0f, 1.0f, 1.0f); // the instances carry the colour
+    
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "instancing benchmark: order " << order << ", " << nInds / 3 << " triangles per sphere, ";
+    std::cout << nFrames << " frames" << std::endl;
+    std::cout << "  spheres   per draw ms  instanced ms  speed up  Mtri/s" << std::endl;
+    for(GLuint count=1; count<=maxCount; count*=4){
+        auto insts = grid(count);
+        // one glDrawElements per sphere, its place given as generic attributes
+        oglWrap::setInstances({});
+        double each = timeFrames(nFrames, [&]{
+            for(auto &inst: insts){
+                oglWrap::setInstance(inst);
+                oglWrap::draw(nInds, 0);
+            }
+        });
+        // one call for them all
+        oglWrap::setInstances(insts);
+        double inst = timeFrames(nFrames, [&]{ oglWrap::drawInstanced(nInds, 0, count); });
+        std::cout << std::setw(9) << count << std::setw(14) << each << std::setw(14) << inst;
+        std::cout << std::setw(10) << each / inst << std::setw(8) << nInds / 3 * count / inst * 1e-3 << std::endl;
+        if(count > std::numeric_limits<GLuint>::max() / 4) break;
+    }
+    oglWrap::setInstances({});
+    oglWrap::deleteBuff();
+}
+
+static double msSince(std::chrono::high_resolution_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+// each step from order n - 1 to n is timed both ways, first building order n
+// from the octahedron and uploading all of it, then refining order n - 1
+// and sending only its new vertices
+void gpuBench::refine(GLuint maxOrder)
+{
+    sphere::setBaked(false);
+    sphere::setCache(false);
+    sphere::setOptimize(false);
+    sphere::setKeepTopology(true); // refining needs it
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "order   build ms  upload ms  upload KB   refine ms  upload ms  upload KB" << std::endl;
+    for(GLuint n=1; n<=maxOrder; ++n){
+        sphere::release();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        sphere::build(n);
+        double build = msSince(t0);
+        t0 = std::chrono::high_resolution_clock::now();
+        oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+        glFinish();
+        double upload = msSince(t0);
+        const double bytes = sphere::GetVerts().size() * sizeof(GLfloat) + sphere::GetIndBuff().bytes();
+        oglWrap::deleteBuff();
+        
+        sphere::release();
+        sphere::build(n - 1);
+        const std::size_t keep = sphere::GetVerts().size();
+        oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+        glFinish();
+        t0 = std::chrono::high_resolution_clock::now();
+        sphere::build(n);
+        double refine = msSince(t0);
+        t0 = std::chrono::high_resolution_clock::now();
+        const double grown = oglWrap::growBuff(sphere::GetVerts(), keep, sphere::GetIndBuff());
+        glFinish();
+        double regrow = msSince(t0);
+        oglWrap::deleteBuff();
+        std::cout << std::setw(5) << n << std::setw(11) << build << std::setw(11) << upload << std::setw(11) << bytes / 1024;
+        std::cout << std::setw(12) << refine << std::setw(11) << regrow << std::setw(11) << grown / 1024 << std::endl;
+    }
+    sphere::release();
+}
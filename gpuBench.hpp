@@ -0,0 +1,21 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef gpuBenchDec
+#define gpuBenchDec
+
+#ifndef openglDec
+#include "opengl.hpp"
+#endif
+
+// Benchmarks which need a current GL context, with oglWrap::setUp() done.
+namespace gpuBench
+{
+    void indexTypes(GLuint order, GLuint nDraws); // 16 against 32 bit indices
+    std::vector<oglWrap::instance> grid(GLuint count); // count spheres in a cube in view
+    void instances(GLuint order, GLuint maxCount, GLuint nFrames); // one draw per sphere against instancing
+    void refine(GLuint maxOrder); // building and uploading each order afresh against refining
+}
+
+#endif
@@ -0,0 +1,94 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include "headless.hpp"
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static GLuint fbo, colorBuff, depthBuff;
+
+static void eglFail(const std::string &what)
+{
+    std::ostringstream oss;
+    oss << "Error: headless::open(), " << what << " failed, EGL error 0x" << std::hex << eglGetError();
+    throw std::runtime_error(oss.str());
+}
+
+// the surfaceless platform needs no display server, fall back to the default
+// display when the EGL implementation does not offer it
+static EGLDisplay getDisplay()
+{
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay){
+        EGLDisplay dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if(dpy != EGL_NO_DISPLAY) return dpy;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+void headless::open(GLuint width, GLuint height, GLuint major, GLuint minor)
+{
+    display = getDisplay();
+    if(display == EGL_NO_DISPLAY) eglFail("eglGetDisplay()");
+    EGLint eglMajor, eglMinor;
+    if(!eglInitialize(display, &eglMajor, &eglMinor)) eglFail("eglInitialize()");
+    if(!eglBindAPI(EGL_OPENGL_API)) eglFail("eglBindAPI()");
+    
+    // the default surface type is a window, which a surfaceless display has none of
+    const EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint nConfig = 0;
+    if(!eglChooseConfig(display, configAttribs, &config, 1, &nConfig) || nConfig < 1) eglFail("eglChooseConfig()");
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, EGLint(major),
+        EGL_CONTEXT_MINOR_VERSION, EGLint(minor),
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if(context == EGL_NO_CONTEXT) eglFail("eglCreateContext()");
+    if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) eglFail("eglMakeCurrent()");
+    
+    // initialise GLEW, a GLX build of GLEW has no GLX display here but
+    // the GL entry points it loads are all we need
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+    if(err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY)
+        throw std::runtime_error("Error: headless::open(), glewInit() failed");
+    
+    // with no window everything is drawn into a framebuffer object
+    glGenRenderbuffers(1, &colorBuff);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuff);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuff);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuff);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuff);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuff);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Error: headless::open(), framebuffer is incomplete");
+    glViewport(0, 0, width, height);
+}
+
+void headless::close()
+{
+    if(context == EGL_NO_CONTEXT) return;
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &colorBuff);
+    glDeleteRenderbuffers(1, &depthBuff);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    context = EGL_NO_CONTEXT;
+    display = EGL_NO_DISPLAY;
+}
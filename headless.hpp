@@ -0,0 +1,17 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef headlessDec
+#define headlessDec
+
+// An OpenGL core context with no window, made with EGL on a surfaceless
+// display, rendering into a framebuffer object. Mesa's llvmpipe provides
+// this without a GPU or a display server.
+namespace headless
+{
+    void open(GLuint width, GLuint height, GLuint major = 3, GLuint minor = 3);
+    void close();
+}
+
+#endif
@@ -0,0 +1,80 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <future>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include "sphere.hpp"
+#include "lod.hpp"
+
+// spheres scattered through the view from just in front of the camera to
+// near the far plane, with a fixed seed so every run sees the same scene
+std::vector<oglWrap::instance> lod::field(GLuint count)
+{
+    const GLfloat nearD = 3.0f, farD = 150.0f, tanY = 0.2679f, aspect = 4.0f / 3.0f; // 30 degree view
+    std::vector<oglWrap::instance> insts(count);
+    GLuint64 seed = 12345;
+    auto next = [&seed]{ // uniform in [0, 1)
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return GLfloat(seed >> 40) / GLfloat(1 << 24);
+    };
+    for(auto &inst: insts){
+        const GLfloat d = nearD + (farD - nearD) * next();
+        inst.pos[0] = (2.0f * next() - 1.0f) * 0.8f * d * tanY * aspect;
+        inst.pos[1] = (2.0f * next() - 1.0f) * 0.8f * d * tanY;
+        inst.pos[2] = 5.0f - d; // the shader moves everything 5 away
+        inst.scale = 0.5f;
+        for(auto &c: inst.color) c = 0.3f + 0.7f * next();
+    }
+    return insts;
+}
+
+// the coarsest level whose error, on a sphere with a radius of radiusPx
+// pixels on the screen, is within maxErrPx pixels, the finest when none is
+GLuint lod::pick(const levels &lv, GLfloat radiusPx, GLfloat maxErrPx)
+{
+    for(GLuint l=0; l<lv.size(); ++l)
+        if(lv[l].err * radiusPx <= maxErrPx) return l;
+    return lv.size() - 1;
+}
+
+std::vector<GLuint> lod::bucket(const levels &lv, std::vector<oglWrap::instance> &insts, camera cam, GLfloat maxErrPx)
+{
+    std::vector<GLuint> counts(lv.size(), 0), level(insts.size());
+    for(std::size_t i=0; i<insts.size(); ++i){
+        // projected radius, the camera looks down -z
+        const GLfloat d = std::max(-(insts[i].pos[2] + cam.eyeZ), 1e-3f);
+        level[i] = pick(lv, insts[i].scale * cam.focal / d, maxErrPx);
+        ++counts[level[i]];
+    }
+    // counting sort, each level's instances end up contiguous
+    std::vector<GLuint> start(lv.size(), 0);
+    for(std::size_t l=1; l<lv.size(); ++l) start[l] = start[l - 1] + counts[l - 1];
+    std::vector<oglWrap::instance> sorted(insts.size());
+    for(std::size_t i=0; i<insts.size(); ++i) sorted[start[level[i]]++] = insts[i];
+    insts.swap(sorted);
+    return counts;
+}
+
+// the instances must be the ones bucket() sorted
+void lod::draw(const levels &lv, const std::vector<GLuint> &counts)
+{
+    GLuint first = 0;
+    for(std::size_t l=0; l<counts.size(); ++l){
+        if(counts[l] == 0) continue;
+        oglWrap::drawInstanced(lv[l].count, lv[l].offset, counts[l], first);
+        first += counts[l];
+    }
+}
+
+GLuint64 lod::triangles(const levels &lv, const std::vector<GLuint> &counts)
+{
+    GLuint64 n = 0;
+    for(std::size_t l=0; l<counts.size(); ++l) n += counts[l] * lv[l].count / 3;
+    return n;
+}
@@ -0,0 +1,36 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef lodDec
+#define lodDec
+
+#ifndef openglDec
+#include "opengl.hpp"
+#endif
+
+#ifndef sphereDec
+#include "sphere.hpp"
+#endif
+
+// Level of detail for instanced spheres, drawn from a level packed build
+// (sphere::setLevels). Each sphere gets the coarsest order whose error on
+// screen is within a tolerance, and the spheres of each order are drawn
+// with one instanced call.
+namespace lod
+{
+    // how the fixed camera projects, focal is the viewport's half height in
+    // pixels over tan(half the field of view), eyeZ is added to every z
+    struct camera { GLfloat focal, eyeZ; };
+    
+    using levels = std::vector<sphere::level>; // a copy of sphere::GetLevels()
+    
+    std::vector<oglWrap::instance> field(GLuint count); // count spheres going away from the camera
+    GLuint pick(const levels &lv, GLfloat radiusPx, GLfloat maxErrPx); // coarsest level within maxErrPx
+    // sorts the instances by level and returns how many there are of each
+    std::vector<GLuint> bucket(const levels &lv, std::vector<oglWrap::instance> &insts, camera cam, GLfloat maxErrPx);
+    void draw(const levels &lv, const std::vector<GLuint> &counts); // one draw per level in use
+    GLuint64 triangles(const levels &lv, const std::vector<GLuint> &counts);
+}
+
+#endif
@@ -8,13 +8,34 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <future>
 #include <array>
 #include <cmath>
 #include <chrono>
 #include <thread>
+#include <limits>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <random>
+#include <unordered_map>
 
 #include "sphere.hpp"
 #include "opengl.hpp"
+#include "sphereTables.hpp"
+#include "gpuBench.hpp"
+#include "vcache.hpp"
+#include "headless.hpp"
+#include "lod.hpp"
+#include "adaptive.hpp"
+#include "timing.hpp"
+#include "meshExport.hpp"
+#include "vertFormat.hpp"
+#include "sphereIndex.hpp"
 
 GLfloat const *gverts;
 GLuint const *ginds;
@@ -92,7 +113,7 @@ void run2()
     auto inds = sphere::GetInds();
     ginds = inds.data();
     N = inds.size() / 3; // number of triangles
-    for(int i=0; i<N; ++i) print2(i);
+    for(GLuint i=0; i<N; ++i) print2(i);
     std::cout << "finished\n"; 
     
     //std::ifstream fin;
@@ -102,7 +123,9 @@ void run2()
 }
 
 
-void run(unsigned int order)
+// opens the window with a core profile context
+// of at least the version asked for
+GLFWwindow* openWindow(int major = 3, int minor = 3)
 {
     int maj, min, rev;
     glfwGetVersion(&maj, &min, &rev);
@@ -110,81 +133,1103 @@ void run(unsigned int order)
 
 
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor); // 3.3 for instanced attributes, 4.0 to tessellate
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
     GLFWwindow* window = glfwCreateWindow(1200, 900, "OpenGL", nullptr, nullptr); // Windowed
     //GLFWwindow* window = glfwCreateWindow(1920, 1200, "OpenGL", glfwGetPrimaryMonitor(), nullptr); // Fullscreen
+    if(!window) throw std::runtime_error("Error: openWindow(), glfwCreateWindow() failed");
     glfwMakeContextCurrent(window);
     // initialise GLEW
     glewExperimental = GL_TRUE;
     glewInit();
     // basic window is now setup
-    
     oglWrap::info();
+    return window;
+}
+
+// the packed levels and how many spheres use each, when drawing with level of detail
+static lod::levels lodLevels;
+static std::vector<GLuint> lodCounts;
+// 30 degree field of view on a 900 pixel high viewport, the shader moves spheres 5 away
+static const lod::camera lodCam = {450.0f / 0.26795f, -5.0f};
+
+// with tessellate the mesh is order 0 or 1 and is drawn as patches, divided
+// on the GPU into triangles with edges tessPixels long on the screen
+static bool tessellate = false;
+static GLfloat tessPixels = 8.0f;
+
+// the uniforms changed while drawing, looked up once the shaders are set up
+static oglWrap::uniformId uniRotate = -1, uniTessLevel = -1, uniTessPixels = -1;
+
+// shader uniforms which stay fixed for the whole run
+void setUniforms()
+{
+    uniRotate = oglWrap::uniform("rotate");
+    uniTessLevel = oglWrap::uniform("tessLevel");
+    uniTessPixels = oglWrap::uniform("tessPixels");
+    auto perspective = oglWrap::perspective(30.0f, 4.0f/3.0f, 0.1f, 180.0f);
+    oglWrap::setMat4(oglWrap::uniform("perspective"), perspective.data());
+    auto rotateY = oglWrap::rotateY(0.0f);
+    oglWrap::setMat4(uniRotate, rotateY.data());
+    oglWrap::setColor(0.1f, 0.2f, 0.5f);
+    GLfloat lightPos[] = {45.0f, 45.0f, 80.0f}, lightColor[] = {0.9f, 0.9f, 0.9f}, viewPos[] = {0.0f, 0.0f, 50.0f};
+    oglWrap::setVec3(oglWrap::uniform("lightPos"), lightPos);
+    oglWrap::setVec3(oglWrap::uniform("lightColor"), lightColor);
+    oglWrap::setVec3(oglWrap::uniform("viewPos"), viewPos);
+    oglWrap::setFloat(uniTessLevel, 0.0f);
+    oglWrap::setFloat(uniTessPixels, tessPixels);
+    oglWrap::setFloat(oglWrap::uniform("tessScale"), lodCam.focal);
+    // enable depth testing
+    glEnable(GL_DEPTH_TEST); 
+}
+
+// vertex cache efficiency of each order, as built and reordered
+void vcacheReport(unsigned int maxOrder)
+{
+    std::cout << "order  triangles   ACMR built  ACMR opt  ATVR built  ATVR opt" << std::endl;
+    for(GLuint n=0; n<=maxOrder; ++n){
+        vcache::stats st[2];
+        for(int opt=0; opt<2; ++opt){
+            sphere::setOptimize(opt == 1);
+            sphere::build(n);
+            st[opt] = vcache::measure(sphere::GetInds(), sphere::GetVerts().size() / 3);
+        }
+        std::printf("%5u %10llu %12.3f %9.3f %11.3f %9.3f\n", n, (unsigned long long)(sphere::GetNInds() / 3),
+            st[0].acmr, st[1].acmr, st[0].atvr, st[1].atvr);
+    }
+    sphere::setOptimize(false);
+    sphere::release();
+}
+
+// the order drawn from gl_VertexID with no vertex buffers, -1 when the mesh is uploaded
+static GLint procOrder = -1;
+
+// the highest order of a mesh divided for the camera, -1 when the mesh is uniform
+static GLint adaptiveOrder = -1;
+
+// the adaptive mesh for the camera with the sphere turned omega degrees, the
+// eye is taken into the sphere's own frame so the side facing it is divided.
+// It is built in a couple of milliseconds, so it is rebuilt every frame
+static GLuint64 uploadAdaptive(GLfloat omega)
+{
+    const GLfloat theta = omega * 3.1415926535897932f / 180.0f, distance = -lodCam.eyeZ;
+    const GLfloat eye[] = {-distance * std::sin(theta), 0.0f, distance * std::cos(theta)};
+    adaptiveSphere mesh(adaptiveOrder, adaptiveSphere::screenError(eye, lodCam.focal, 0.5f));
+    oglWrap::deleteBuff();
+    oglWrap::createBuff(mesh.GetVerts(), bufView<GLuint>(mesh.GetInds()), vertLayout::pos);
+    return mesh.GetNInds();
+}
+
+// with SPHERE_VCACHE set, drawn meshes are reordered for the vertex cache,
+// once, then cached, otherwise the baked tables and refining serve them
+static bool vcacheWanted()
+{
+    const char *env = std::getenv("SPHERE_VCACHE");
+    return env && *env;
+}
+
+// builds the sphere and hands it to the GPU, returns the number of indices,
+// with levels every order up to order is packed in and lodLevels says where
+GLuint64 upload(unsigned int order, bool levels = false)
+{
+    sphere::setThreads(0); // one per hardware thread
+    sphere::setKeepTopology(false); // only the mesh is drawn
+    sphere::setCache(true); // map the mesh from disk when it has been built before
+    sphere::setOptimize(vcacheWanted()); // opt in, it rules out the baked orders and refining
+    sphere::setLevels(levels);
     sphere::build(order);
-    const GLuint NInds = sphere::GetNInds();
-    auto verts = sphere::GetVertsNorms();
-    auto inds = sphere::GetInds();
-    oglWrap::createBuff(verts, inds);
-    sphere::release();  
+    if(levels) lodLevels = sphere::GetLevels();
+    const GLuint64 NInds = sphere::GetNInds();
+    if(NInds > GLuint64(std::numeric_limits<GLsizei>::max())) 
+        throw std::runtime_error("Error: upload(), too many indices to draw, use a lower order");
+    // positions only, the shader reads each normal from the position
+    oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+    sphere::release(); // also unmaps a cached mesh
+    return NInds;
+}
+
+// an order built in the background, then staged onto the GPU a slice a
+// frame while the current mesh is still drawn, and swapped in between frames
+static std::future<sphere::mesh> nextBuild;
+static sphere::mesh nextMesh;
+static bool staging = false;
+static const std::size_t stageBytes = 8 << 20; // uploaded per frame
+static const GLuint maxKeyOrder = 10; // 8 million triangles
+
+static bool building()
+{
+    return nextBuild.valid() || staging;
+}
+
+// call at the start of a frame, moves a background build on by a step,
+// returns true when the new mesh has been swapped in, with NInds and order updated
+static bool advanceBuild(GLuint64 &NInds, GLuint &order)
+{
+    timing::scope t("stage");
+    if(nextBuild.valid()){
+        if(nextBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+        nextMesh = nextBuild.get();
+        if(nextMesh.GetNInds() > GLuint64(std::numeric_limits<GLsizei>::max()))
+            throw std::runtime_error("Error: advanceBuild(), too many indices to draw, use a lower order");
+        oglWrap::stageBuff(nextMesh.verts, nextMesh.GetIndBuff(), vertLayout::pos);
+        staging = true;
+    }
+    if(!staging || !oglWrap::stageStep(stageBytes)) return false;
+    oglWrap::swapBuff();
+    NInds = nextMesh.GetNInds();
+    order = nextMesh.order;
+    if(!nextMesh.levels.empty()) lodLevels = nextMesh.levels;
+    nextMesh = sphere::mesh();
+    staging = false;
+    return true;
+}
+
+// one frame of the sphere, turned omega degrees about the y axis,
+// or of nInstances spheres set with oglWrap::setInstances()
+void drawFrame(GLfloat omega, GLuint64 NInds, GLuint nInstances = 0)
+{
+    {
+        timing::scope t("clear", true);
+        // Clear the screen to black
+        oglWrap::clear(0.0f, 0.0f, 0.0f);
+    }
+    {
+        timing::scope t("uniforms");
+        // rotate on y axis
+        auto &rotateY = oglWrap::rotateY(omega);
+        oglWrap::setMat4(uniRotate, rotateY.data());
+        // the instances carry the colour
+        if(!lodCounts.empty() || nInstances) oglWrap::setColor(1.0f, 1.0f, 1.0f);
+        else oglWrap::setColor(0.1f, 0.2f, 0.5f);
+    }
+
+    // the uniforms go to the GPU with the first draw
+    timing::scope t("draw", true);
+    if(!lodCounts.empty()) lod::draw(lodLevels, lodCounts);
+    else if(procOrder >= 0) oglWrap::drawProcedural(procOrder, nInstances);
+    else if(tessellate) oglWrap::drawPatches(NInds, 0, nInstances);
+    else if(nInstances == 0) oglWrap::draw(NInds, 0);
+    else oglWrap::drawInstanced(NInds, 0, nInstances);
+}
+
+// with SPHERE_TRACE naming a file, frames are timed on the CPU and GPU
+// and the timeline is written there when done
+static const char* traceFile()
+{
+    return std::getenv("SPHERE_TRACE");
+}
+
+static void startTrace()
+{
+    if(traceFile()) timing::enable();
+}
+
+static void endTrace()
+{
+    if(!timing::enabled()) return;
+    timing::writeTrace(traceFile());
+    timing::report();
+    timing::close();
+}
+
+// renders frames as fast as possible into an offscreen framebuffer, each
+// frame is finished before the next starts so its time is the whole cost
+void benchHeadless(unsigned int maxOrder, unsigned int frames)
+{
+    if(frames == 0) throw std::runtime_error("Error: benchHeadless(), need at least one frame");
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    startTrace();
+    std::printf("order  triangles   mean ms    p50 ms    p99 ms   Mtri/s  GL calls/frame\n");
+    for(GLuint n=0; n<=maxOrder; ++n){
+        const GLuint64 NInds = upload(n);
+        std::vector<double> ms(frames);
+        drawFrame(0.0f, NInds); // warm up
+        glFinish();
+        oglWrap::glCalls(); // counted from here
+        for(GLuint f=0; f<frames; ++f){
+            auto t0 = std::chrono::high_resolution_clock::now();
+            timing::beginFrame();
+            drawFrame(0.5f * f, NInds);
+            timing::endFrame();
+            {
+                timing::scope t("finish");
+                glFinish();
+            }
+            auto t1 = std::chrono::high_resolution_clock::now();
+            ms[f] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        }
+        double mean = 0.0;
+        for(auto t: ms) mean += t;
+        mean /= frames;
+        std::sort(ms.begin(), ms.end());
+        const double p50 = ms[frames / 2], p99 = ms[std::min<std::size_t>(frames - 1, (99 * frames + 99) / 100 - 1)];
+        std::printf("%5u %10llu %9.3f %9.3f %9.3f %8.2f %15.1f\n", n, (unsigned long long)(NInds / 3), mean, p50, p99,
+            NInds / 3 / mean * 1e-3, double(oglWrap::glCalls()) / frames);
+        oglWrap::deleteBuff();
+    }
+    endTrace();
+    oglWrap::close();
+    headless::close();
+}
+
+// one draw per sphere against a single instanced draw, for 1, 4, 16 ... spheres
+void benchInstances(unsigned int order, unsigned int maxCount, unsigned int frames)
+{
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    gpuBench::instances(order, maxCount, frames);
+    oglWrap::close();
+    headless::close();
+}
+
+// all spheres at the top order against each at the order its size on screen needs
+void benchLod(unsigned int order, unsigned int count, unsigned int frames)
+{
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    upload(order, true);
+    auto insts = lod::field(count);
+    const lod::levels &lv = lodLevels;
+    std::vector<GLuint> top(lv.size(), 0);
+    top.back() = count;
+    std::printf("max error px  triangles  frame ms  spheres per order\n");
+    for(GLfloat maxErr: {0.0f, 0.125f, 0.5f, 2.0f}){
+        // zero error puts every sphere on the top order
+        auto counts = maxErr == 0.0f ? top : lod::bucket(lv, insts, lodCam, maxErr);
+        oglWrap::setInstances(insts);
+        lod::draw(lv, counts); // warm up
+        glFinish();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for(GLuint f=0; f<frames; ++f){
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            lod::draw(lv, counts);
+            glFinish();
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        std::printf("%12.3f %10llu %9.3f ", maxErr, (unsigned long long) lod::triangles(lv, counts),
+            std::chrono::duration<double, std::milli>(t1 - t0).count() / frames);
+        for(auto c: counts) std::printf(" %u", c);
+        std::printf("\n");
+    }
+    oglWrap::close();
+    headless::close();
+}
+
+// the size and accuracy of each vertex layout, then on the GPU the frame
+// time and how much of the picture differs from the float positions
+void benchFormats(unsigned int order, unsigned int frames)
+{
+    if(frames == 0) throw std::runtime_error("Error: benchFormats(), need at least one frame");
+    sphere::setThreads(0);
+    sphere::setKeepTopology(false);
+    sphere::setCache(true);
+    sphere::setOptimize(true);
+    sphere::setLevels(false);
+    sphere::build(order);
+    const GLuint64 NInds = sphere::GetNInds();
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    std::vector<unsigned char> ref, pixels(1200 * 900 * 4);
+    std::printf("layout   bytes/vertex  vertex MB  smaller  max angle deg  frame ms  pixels differing  max diff\n");
+    for(auto layout: {vertLayout::posNorm, vertLayout::pos, vertLayout::half, vertLayout::oct16}){
+        const auto verts = layout == vertLayout::posNorm ? sphere::GetVertsNorms() : sphere::GetVerts();
+        const std::size_t nVerts = verts.size() / vertFormat::floats(layout), stride = vertFormat::stride(layout);
+        const double angle = vertFormat::maxAngle(layout, verts);
+        oglWrap::createBuff(verts, sphere::GetIndBuff(), layout);
+        drawFrame(30.0f, NInds); // warm up, and the picture compared
+        glReadPixels(0, 0, 1200, 900, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        if(ref.empty()) ref = pixels;
+        GLuint64 differ = 0;
+        int worst = 0;
+        for(std::size_t i=0; i<pixels.size(); i+=4){
+            int d = 0;
+            for(int k=0; k<3; ++k) d = std::max(d, std::abs(int(pixels[i + k]) - int(ref[i + k])));
+            if(d) ++differ;
+            worst = std::max(worst, d);
+        }
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for(GLuint f=0; f<frames; ++f){
+            drawFrame(0.5f * f, NInds);
+            glFinish();
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        std::printf("%-8s %12zu %10.2f %8.1f %14.6f %9.3f %17llu %9d\n", vertFormat::name(layout), stride,
+            nVerts * stride / 1048576.0, double(vertFormat::stride(vertLayout::posNorm)) / stride, angle,
+            std::chrono::duration<double, std::milli>(t1 - t0).count() / frames, (unsigned long long) differ, worst);
+        oglWrap::deleteBuff();
+    }
+    sphere::release();
+    oglWrap::close();
+    headless::close();
+}
+
+// the triangles vertex.shader makes from gl_VertexID against the builder's,
+// each captured corner is matched to the nearest built vertex through a
+// grid of cells, then the triangles as index triples must be the same set
+// with the same winding, in any order
+bool checkProcedural(unsigned int maxOrder)
+{
+    headless::open(64, 64);
+    oglWrap::setUp();
+    sphere::setThreads(0);
+    sphere::setKeepTopology(false);
+    sphere::setCache(false);
+    sphere::setOptimize(false);
+    sphere::setLevels(false);
+    bool ok = true;
+    std::printf("order  triangles   vertices  max distance  triangles match\n");
+    for(GLuint n=0; n<=maxOrder; ++n){
+        sphere::build(n);
+        const auto verts = sphere::GetVerts();
+        const auto inds = sphere::GetInds();
+        const std::vector<GLfloat> corners = oglWrap::captureProcedural(n);
+        const std::size_t nVerts = verts.size() / 3, nCorners = corners.size() / 3;
+
+        // cells a quarter of the shortest edge wide, which is over a third of the longest
+        const double cell = 0.25 * 1.5707963 / (1 << n);
+        auto key = [cell](double x, double y, double z){
+            auto c = [cell](double v){ return std::uint64_t(std::int64_t(std::floor(v / cell)) + (1 << 20)); };
+            return (c(x) << 42) | (c(y) << 21) | c(z);
+        };
+        std::unordered_multimap<std::uint64_t, GLuint> grid;
+        grid.reserve(nVerts);
+        for(std::size_t i=0; i<nVerts; ++i) grid.emplace(key(verts[3 * i], verts[3 * i + 1], verts[3 * i + 2]), GLuint(i));
+        std::vector<GLuint> matched(nCorners);
+        double worst = 0.0;
+        for(std::size_t i=0; i<nCorners && ok; ++i){
+            const GLfloat *p = &corners[3 * i];
+            double best = std::numeric_limits<double>::max();
+            for(int dx=-1; dx<=1; ++dx) for(int dy=-1; dy<=1; ++dy) for(int dz=-1; dz<=1; ++dz){
+                auto range = grid.equal_range(key(p[0] + dx * cell, p[1] + dy * cell, p[2] + dz * cell));
+                for(auto it=range.first; it!=range.second; ++it){
+                    const GLfloat *v = &verts[3 * it -> second];
+                    const double d = std::hypot(double(p[0]) - v[0], double(p[1]) - v[1], double(p[2]) - v[2]);
+                    if(d < best){
+                        best = d;
+                        matched[i] = it -> second;
+                    }
+                }
+            }
+            worst = std::max(worst, best);
+            if(best > 1e-4) ok = false; // no built vertex there
+        }
+        // each triangle starts from its lowest index, which keeps the winding
+        auto triangles = [](auto get, std::size_t nTri){
+            std::vector<std::array<GLuint, 3>> t(nTri);
+            for(std::size_t i=0; i<nTri; ++i){
+                std::array<GLuint, 3> a = {get(3 * i), get(3 * i + 1), get(3 * i + 2)};
+                std::rotate(a.begin(), std::min_element(a.begin(), a.end()), a.end());
+                t[i] = a;
+            }
+            std::sort(t.begin(), t.end());
+            return t;
+        };
+        const bool same = ok && inds.size() == nCorners &&
+            triangles([&](std::size_t i){ return matched[i]; }, nCorners / 3) ==
+            triangles([&](std::size_t i){ return inds[i]; }, inds.size() / 3);
+        ok = ok && same;
+        std::printf("%5u %10zu %10zu %13.3g  %s\n", n, nCorners / 3, nVerts, worst, same ? "yes" : "NO");
+        if(!ok) break;
+    }
+    sphere::release();
+    oglWrap::close();
+    headless::close();
+    return ok;
+}
+
+// each order from 1 up, refined from the order before, against a fresh build,
+// with the topology kept throughout, with it dropped once refined, and from a
+// level packed sphere, which must be built afresh rather than refined
+bool checkRefine(unsigned int maxOrder)
+{
+    maxOrder = std::min(maxOrder, sphere::maxn);
+    sphere::setThreads(0);
+    sphere::setCache(false);
+    sphere::setBaked(false); // the baked orders are never refined
+    sphere::setOptimize(false);
+    bool ok = true;
+    std::printf("order  kept topology  dropped once refined  from level packed\n");
+    for(GLuint n=1; n<=maxOrder; ++n){
+        sphere::release();
+        sphere::setKeepTopology(false);
+        sphere::setLevels(false);
+        sphere::build(n);
+        const auto v = sphere::GetVerts();
+        const auto i = sphere::GetInds();
+        const std::vector<GLfloat> verts(v.begin(), v.end());
+        const std::vector<GLuint> inds(i.begin(), i.end());
+        // the lower order is built with keep and packed, then order n with dropKeep
+        auto same = [&](bool keep, bool packed, bool dropKeep){
+            sphere::release();
+            sphere::setKeepTopology(keep);
+            sphere::setLevels(packed);
+            sphere::build(n - 1);
+            sphere::setKeepTopology(!dropKeep);
+            sphere::setLevels(false);
+            try{
+                sphere::build(n);
+            }
+            catch(const std::runtime_error &e){
+                std::cerr << e.what() << std::endl;
+                return false;
+            }
+            const auto rv = sphere::GetVerts();
+            const auto ri = sphere::GetInds();
+            return rv.size() == verts.size() && ri.size() == inds.size()
+                && std::equal(rv.begin(), rv.end(), verts.begin()) && std::equal(ri.begin(), ri.end(), inds.begin());
+        };
+        const bool kept = same(true, false, false), dropped = same(true, false, true), packed = same(true, true, false);
+        std::printf("%5u  %13s  %20s  %17s\n", n, kept ? "yes" : "NO", dropped ? "yes" : "NO", packed ? "yes" : "NO");
+        ok = ok && kept && dropped && packed;
+    }
+    sphere::release();
+    sphere::setBaked(true);
+    sphere::setLevels(false);
+    return ok;
+}
+
+// the stored and uploaded mesh against the procedural one for each order,
+// the start up cost, memory, frame time and how many pixels differ
+void benchProcedural(unsigned int maxOrder, unsigned int frames)
+{
+    if(frames == 0) throw std::runtime_error("Error: benchProcedural(), need at least one frame");
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    sphere::setThreads(0);
+    sphere::setKeepTopology(false);
+    sphere::setCache(false); // the cost of having no vertices is the build it saves
+    sphere::setOptimize(true);
+    sphere::setLevels(false);
+    std::vector<unsigned char> ref(1200 * 900 * 4), pixels(ref.size());
+    std::printf("order  stored: setup ms  GPU MB  frame ms   procedural: setup ms  frame ms   pixels differing  max diff\n");
+    for(GLuint n=0; n<=maxOrder; ++n){
+        double setup[2], frame[2], mb = 0.0;
+        for(int proc=0; proc<2; ++proc){
+            auto t0 = std::chrono::high_resolution_clock::now();
+            GLuint64 NInds = 0;
+            if(proc){
+                oglWrap::createProcedural();
+                procOrder = n;
+            }
+            else{
+                sphere::build(n);
+                NInds = sphere::GetNInds();
+                mb = (sphere::GetVerts().size() * sizeof(GLfloat) + sphere::GetIndBuff().bytes()) / 1048576.0;
+                oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+                sphere::release();
+            }
+            drawFrame(30.0f, NInds); // the first frame is part of starting up
+            glReadPixels(0, 0, 1200, 900, GL_RGBA, GL_UNSIGNED_BYTE, (proc ? pixels : ref).data());
+            auto t1 = std::chrono::high_resolution_clock::now();
+            for(GLuint f=0; f<frames; ++f){
+                drawFrame(0.5f * f, NInds);
+                glFinish();
+            }
+            auto t2 = std::chrono::high_resolution_clock::now();
+            setup[proc] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            frame[proc] = std::chrono::duration<double, std::milli>(t2 - t1).count() / frames;
+            procOrder = -1;
+            oglWrap::deleteBuff();
+        }
+        GLuint64 differ = 0;
+        int worst = 0;
+        for(std::size_t i=0; i<pixels.size(); i+=4){
+            int d = 0;
+            for(int k=0; k<3; ++k) d = std::max(d, std::abs(int(pixels[i + k]) - int(ref[i + k])));
+            if(d) ++differ;
+            worst = std::max(worst, d);
+        }
+        std::printf("%5u %17.2f %7.2f %9.3f %22.2f %9.3f %18llu %9d\n", n, setup[0], mb, frame[0], setup[1], frame[1],
+            (unsigned long long) differ, worst);
+    }
+    oglWrap::close();
+    headless::close();
+}
+
+// the triangles of the frame drawn next, as they come out of the last stage
+// before rasterising, so tessellated triangles are counted
+static GLuint64 trianglesDrawn(GLfloat omega, GLuint64 NInds)
+{
+    GLuint query;
+    glGenQueries(1, &query);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+    drawFrame(omega, NInds);
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    GLuint64 n = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &n);
+    glDeleteQueries(1, &query);
+    return n;
+}
+
+// builds order and hands it to the GPU, uncached, returns the number of indices
+static GLuint64 uploadBuilt(unsigned int order)
+{
+    sphere::build(order);
+    const GLuint64 NInds = sphere::GetNInds();
+    oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+    sphere::release();
+    return NInds;
+}
+
+// meshes built on the CPU against the order 0 or 1 sphere tessellated on the
+// GPU. Each order n is matched by dividing every patch edge into as many
+// pieces as order n has on the edge of an octahedron face, then the patches
+// are divided by their size on the screen instead
+void benchTess(unsigned int maxOrder, unsigned int frames)
+{
+    if(frames == 0) throw std::runtime_error("Error: benchTess(), need at least one frame");
+    headless::open(1200, 900, 4, 0);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    sphere::setThreads(0);
+    sphere::setKeepTopology(false);
+    sphere::setCache(false); // a change of density is a full build
+    sphere::setOptimize(true);
+    sphere::setLevels(false);
+    GLint maxLevel = 0;
+    glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxLevel);
+    std::vector<unsigned char> ref(1200 * 900 * 4), pixels(ref.size());
+    auto frameMs = [frames](GLuint64 NInds){
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for(GLuint f=0; f<frames; ++f){
+            drawFrame(0.5f * f, NInds);
+            glFinish();
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(t1 - t0).count() / frames;
+    };
+    auto msSince = [](std::chrono::high_resolution_clock::time_point t0){
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    };
+    tessellate = true; // the tessellation program is built before anything is timed
+    drawFrame(0.0f, uploadBuilt(0));
+    tessellate = false;
+    oglWrap::deleteBuff();
+
+    std::printf("order  CPU: triangles  setup ms  frame ms   GPU: patches level  triangles  setup ms  frame ms   pixels differing\n");
+    for(GLuint n=0; n<=maxOrder; ++n){
+        auto t0 = std::chrono::high_resolution_clock::now();
+        GLuint64 NInds = uploadBuilt(n);
+        drawFrame(30.0f, NInds);
+        glReadPixels(0, 0, 1200, 900, GL_RGBA, GL_UNSIGNED_BYTE, ref.data());
+        const double setup = msSince(t0), frame = frameMs(NInds);
+        const GLuint64 cpuTriangles = NInds / 3;
+        oglWrap::deleteBuff();
+
+        const GLuint patches = GLuint(1) << n > GLuint(maxLevel) ? 1 : 0, level = 1 << (n - patches);
+        if(level > GLuint(maxLevel)){
+            std::printf("%5u %15llu %9.2f %9.3f   past GL_MAX_TESS_GEN_LEVEL %d\n", n, (unsigned long long) cpuTriangles,
+                setup, frame, maxLevel);
+            continue;
+        }
+        t0 = std::chrono::high_resolution_clock::now();
+        NInds = uploadBuilt(patches);
+        tessellate = true;
+        oglWrap::setFloat(uniTessLevel, GLfloat(level));
+        drawFrame(30.0f, NInds);
+        glReadPixels(0, 0, 1200, 900, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        const double tessSetup = msSince(t0), tessFrame = frameMs(NInds);
+        const GLuint64 triangles = trianglesDrawn(30.0f, NInds);
+        GLuint64 differ = 0;
+        for(std::size_t i=0; i<pixels.size(); i+=4)
+            if(pixels[i] != ref[i] || pixels[i + 1] != ref[i + 1] || pixels[i + 2] != ref[i + 2]) ++differ;
+        std::printf("%5u %15llu %9.2f %9.3f %15u %6u %10llu %9.2f %9.3f %18llu\n", n, (unsigned long long) cpuTriangles,
+            setup, frame, patches, level, (unsigned long long) triangles, tessSetup, tessFrame, (unsigned long long) differ);
+        oglWrap::setFloat(uniTessLevel, 0.0f);
+        tessellate = false;
+        oglWrap::deleteBuff();
+    }
+
+    std::printf("\nby size on screen, order 1 patches\nedge pixels  triangles  frame ms\n");
+    const GLuint64 NInds = uploadBuilt(1);
+    tessellate = true;
+    for(GLfloat px: {32.0f, 16.0f, 8.0f, 4.0f, 2.0f, 1.0f}){
+        oglWrap::setFloat(uniTessPixels, px);
+        const GLuint64 triangles = trianglesDrawn(30.0f, NInds);
+        std::printf("%11.0f %10llu %9.3f\n", px, (unsigned long long) triangles, frameMs(NInds));
+    }
+    tessellate = false;
+    oglWrap::setFloat(uniTessPixels, tessPixels);
+    oglWrap::deleteBuff();
+    oglWrap::close();
+    headless::close();
+}
+
+// the triangle whose cone from the centre holds p, by trying every one,
+// sphereIndex::none for none
+static GLuint bruteLocate(bufView<GLfloat> verts, bufView<GLuint> inds, const GLfloat *p)
+{
+    auto det = [](const GLfloat *a, const GLfloat *b, const GLfloat *c){
+        return a[0] * (double(b[1]) * c[2] - double(b[2]) * c[1]) + a[1] * (double(b[2]) * c[0] - double(b[0]) * c[2])
+             + a[2] * (double(b[0]) * c[1] - double(b[1]) * c[0]);
+    };
+    for(std::size_t t=0; t<inds.size(); t+=3){
+        const GLfloat *a = &verts[3 * inds[t]], *b = &verts[3 * inds[t + 1]], *c = &verts[3 * inds[t + 2]];
+        const double s = det(a, b, c) < 0.0 ? -1.0 : 1.0;
+        if(s * det(p, a, b) >= 0.0 && s * det(p, b, c) >= 0.0 && s * det(p, c, a) >= 0.0) return GLuint(t / 3);
+    }
+    return sphereIndex::none;
+}
+
+// the nearest triangle ahead on the ray by trying every one, with its distance in t
+static GLuint bruteRay(bufView<GLfloat> verts, bufView<GLuint> inds, const GLfloat *o, const GLfloat *d, double &tBest)
+{
+    GLuint best = sphereIndex::none;
+    tBest = std::numeric_limits<double>::max();
+    for(std::size_t t=0; t<inds.size(); t+=3){
+        const GLfloat *a = &verts[3 * inds[t]], *b = &verts[3 * inds[t + 1]], *c = &verts[3 * inds[t + 2]];
+        double e1[3], e2[3], tv[3];
+        for(int k=0; k<3; ++k){
+            e1[k] = double(b[k]) - a[k];
+            e2[k] = double(c[k]) - a[k];
+            tv[k] = double(o[k]) - a[k];
+        }
+        const double pv[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+        const double det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+        if(det == 0.0) continue;
+        const double qv[3] = {tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0]};
+        const double u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) / det;
+        const double v = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) / det;
+        const double dist = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) / det;
+        if(u >= 0.0 && v >= 0.0 && u + v <= 1.0 && dist >= 0.0 && dist < tBest){
+            tBest = dist;
+            best = GLuint(t / 3);
+        }
+    }
+    return best;
+}
+
+// queries a second through sphereIndex, one at a time and batched with
+// each kernel, against trying every triangle, on the mesh as drawn, which
+// is reordered for the vertex cache. Brute force takes as many queries as
+// keep it to a few seconds, and its answers are compared with the index's
+void benchLocate(unsigned int order, unsigned int queries)
+{
+    if(queries == 0) throw std::runtime_error("Error: benchLocate(), need at least one query");
+    sphere::setThreads(0);
+    sphere::setKeepTopology(false);
+    sphere::setCache(true);
+    sphere::setOptimize(true);
+    sphere::setLevels(false);
+    sphere::build(order);
+    const auto verts = sphere::GetVerts();
+    const auto inds = sphere::GetInds();
+    auto t0 = std::chrono::high_resolution_clock::now();
+    const sphereIndex index(verts, inds);
+    auto msSince = [](std::chrono::high_resolution_clock::time_point t0){
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    };
+    const double buildMs = msSince(t0);
+    const std::size_t nTri = inds.size() / 3, nBrute = std::min<std::size_t>(queries, std::max<std::size_t>(16, 50000000 / nTri));
+    std::printf("order %u, %zu triangles, index built in %.1f ms, holding %llu bytes beyond the mesh\n", order, nTri, buildMs,
+        (unsigned long long) index.bytes());
+
+    // directions all over the sphere, and rays from 3 radii out aimed
+    // within 1.1 radii of the centre, so a few miss
+    std::mt19937 rng(2019);
+    std::normal_distribution<GLfloat> gauss;
+    std::uniform_real_distribution<GLfloat> uniform(-1.1f, 1.1f);
+    std::vector<GLfloat> dirs(3 * std::size_t(queries)), origins(dirs.size()), rays(dirs.size());
+    for(std::size_t i=0; i<queries; ++i){
+        GLfloat r = 0.0f;
+        for(int k=0; k<3; ++k){
+            origins[3 * i + k] = gauss(rng);
+            r += origins[3 * i + k] * origins[3 * i + k];
+        }
+        r = std::sqrt(r);
+        for(int k=0; k<3; ++k){
+            dirs[3 * i + k] = gauss(rng);
+            origins[3 * i + k] *= 3.0f / r;
+            rays[3 * i + k] = uniform(rng) - origins[3 * i + k];
+        }
+    }
+    std::vector<GLuint> single(queries), scalar(queries), batched(queries);
+    std::vector<sphereIndex::hit> hits(queries), hitsBatched(queries);
+    std::printf("query                      queries/s\n");
+    auto report = [&](const char *what, std::size_t n, std::chrono::high_resolution_clock::time_point t0){
+        std::printf("%-24s %12.0f\n", what, n / msSince(t0) * 1e3);
+    };
+    t0 = std::chrono::high_resolution_clock::now();
+    for(std::size_t i=0; i<queries; ++i) single[i] = index.locate(&dirs[3 * i]);
+    report("locate, one at a time", queries, t0);
+    t0 = std::chrono::high_resolution_clock::now();
+    index.locate(dirs.data(), queries, scalar.data(), sphereIndex::kernel::scalar);
+    report("locate, batch scalar", queries, t0);
+    const bool avx2 = std::string(sphereIndex::name(sphereIndex::kernel::automatic)) == "avx2";
+    if(avx2){
+        t0 = std::chrono::high_resolution_clock::now();
+        index.locate(dirs.data(), queries, batched.data(), sphereIndex::kernel::avx2);
+        report("locate, batch avx2", queries, t0);
+    }
+    else batched = scalar;
+    t0 = std::chrono::high_resolution_clock::now();
+    std::size_t locateAgree = 0;
+    for(std::size_t i=0; i<nBrute; ++i) locateAgree += bruteLocate(verts, inds, &dirs[3 * i]) == batched[i];
+    report("locate, brute force", nBrute, t0);
+
+    t0 = std::chrono::high_resolution_clock::now();
+    for(std::size_t i=0; i<queries; ++i) index.intersect(&origins[3 * i], &rays[3 * i], hits[i]);
+    report("ray, one at a time", queries, t0);
+    t0 = std::chrono::high_resolution_clock::now();
+    index.intersect(origins.data(), rays.data(), queries, hitsBatched.data());
+    report(avx2 ? "ray, batch avx2" : "ray, batch scalar", queries, t0);
+    t0 = std::chrono::high_resolution_clock::now();
+    std::size_t rayAgree = 0, rayHits = 0;
+    for(std::size_t i=0; i<nBrute; ++i){
+        double t;
+        const GLuint tri = bruteRay(verts, inds, &origins[3 * i], &rays[3 * i], t);
+        // on an edge either triangle is right, so the same distance counts
+        rayAgree += tri == hitsBatched[i].tri || (tri != sphereIndex::none && hitsBatched[i].tri != sphereIndex::none &&
+            std::abs(t - hitsBatched[i].t) < 1e-5);
+        rayHits += tri != sphereIndex::none;
+    }
+    report("ray, brute force", nBrute, t0);
+
+    bool same = single == scalar && scalar == batched;
+    for(std::size_t i=0; i<queries; ++i) same = same && hits[i].tri == hitsBatched[i].tri;
+    std::printf("one at a time, scalar and batched answers the same: %s\n", same ? "yes" : "NO");
+    std::printf("brute force agrees: locate %zu of %zu, rays %zu of %zu, %zu of them hits\n", locateAgree, nBrute,
+        rayAgree, nBrute, rayHits);
+    sphere::release();
+}
+
+// writes the order n sphere to dir as sphere-n.ply, .gltf with .bin and .raw
+void exportMesh(unsigned int order, const std::string &dir)
+{
+    sphere::setThreads(0);
+    sphere::setKeepTopology(false);
+    sphere::setCache(true);
+    sphere::build(order);
+    const std::string name = dir + "/sphere-" + std::to_string(order);
+    std::printf("file                                  MB        ms      MB/s\n");
+    for(auto write: {meshExport::ply, meshExport::gltf, meshExport::raw}){
+        const meshExport::result r = write(name, sphere::GetVerts(), sphere::GetInds());
+        std::printf("%-30s %9.1f %9.1f %9.1f\n", r.file.c_str(), r.bytes / 1048576.0, r.ms, r.bytes / 1048576.0 / r.ms * 1e3);
+    }
+    sphere::release();
+}
+
+// frame times across a change from one order to another, built and uploaded
+// inside a frame against built in the background and staged a slice a frame
+void benchSwap(unsigned int from, unsigned int to, unsigned int frames)
+{
+    if(frames < 2) throw std::runtime_error("Error: benchSwap(), need at least two frames");
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    std::printf("mode          old ms  worst building ms  swap ms    new ms    frame\n");
+    for(bool async: {false, true}){
+        GLuint64 NInds = upload(from);
+        sphere::setCache(false); // the new order is built, the slowest case
+        GLuint shown = from, swapped = 0;
+        std::vector<double> ms(frames);
+        drawFrame(0.0f, NInds); // warm up
+        glFinish();
+        for(GLuint f=0; f<frames; ++f){
+            auto t0 = std::chrono::high_resolution_clock::now();
+            if(f == 1 && async) nextBuild = sphere::buildAsync(to);
+            if(f == 1 && !async){
+                sphere::build(to);
+                oglWrap::deleteBuff();
+                oglWrap::createBuff(sphere::GetVerts(), sphere::GetIndBuff(), vertLayout::pos);
+                NInds = sphere::GetNInds();
+                sphere::release();
+                shown = to;
+                swapped = f;
+            }
+            if(async && advanceBuild(NInds, shown)) swapped = f;
+            drawFrame(0.5f * f, NInds);
+            glFinish();
+            auto t1 = std::chrono::high_resolution_clock::now();
+            ms[f] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        }
+        while(building()) advanceBuild(NInds, shown); // finishes a late one
+        oglWrap::deleteBuff();
+        if(swapped == 0){
+            std::printf("%-10s  not swapped within %u frames\n", async ? "background" : "inline", frames);
+            continue;
+        }
+        // the old mesh, the frames while the new one is readied, the frame
+        // it is first drawn on and the new mesh after that
+        auto median = [](std::vector<double> v){
+            if(v.empty()) return 0.0;
+            std::sort(v.begin(), v.end());
+            return v[v.size() / 2];
+        };
+        const double worst = swapped > 1 ? *std::max_element(ms.begin() + 1, ms.begin() + swapped) : 0.0;
+        std::printf("%-10s %9.3f %16.3f %10.3f %9.3f %8u\n", async ? "background" : "inline", ms[0], worst, ms[swapped],
+            median(std::vector<double>(ms.begin() + swapped + 1, ms.end())), swapped);
+    }
+    oglWrap::close();
+    headless::close();
+}
+
+// adaptive against uniform subdivision, for a camera distance away from
+// the centre of the unit sphere, with half a pixel of error allowed
+void adaptiveReport(unsigned int maxOrder, GLfloat distance)
+{
+    const GLfloat eye[] = {0.0f, 0.0f, distance};
+    auto t0 = std::chrono::high_resolution_clock::now();
+    adaptiveSphere mesh(maxOrder, adaptiveSphere::screenError(eye, lodCam.focal, 0.5f));
+    auto t1 = std::chrono::high_resolution_clock::now();
+    maxOrder = mesh.GetMaxOrder(); // held to sphere::maxn
+    const GLuint64 uniform = GLuint64(8) << 2 * maxOrder;
+    std::printf("adaptive order %u from %.2f radii: %llu triangles, %.2f%% of uniform, %zu vertices, %.3f ms, %s\n",
+        maxOrder, distance, (unsigned long long)(mesh.GetNInds() / 3), 100.0 * mesh.GetNInds() / 3 / uniform,
+        mesh.GetVerts().size() / 3, std::chrono::duration<double, std::milli>(t1 - t0).count(),
+        mesh.closed() ? "closed" : "NOT CLOSED");
+    std::printf("leaves per order:");
+    for(GLuint n=0; n<=maxOrder; ++n) std::printf(" %u", mesh.levelCount(n));
+    std::printf("\n");
+}
+
+void benchRefine(unsigned int maxOrder)
+{
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    gpuBench::refine(maxOrder);
+    oglWrap::close();
+    headless::close();
+}
+
+void benchIndex(unsigned int order)
+{
+    headless::open(1200, 900);
+    oglWrap::info();
+    oglWrap::setUp();
+    setUniforms();
+    gpuBench::indexTypes(order, 200);
+    oglWrap::close();
+    headless::close();
+}
+
+// count spheres are drawn with one instanced call, a count of 0 draws the single sphere,
+// with levels they go off into the distance drawn with orders up to order,
+// procedural spheres are made in the shader and have nothing to upload,
+// with tessellate order is that of the patches
+void run(unsigned int order, unsigned int count, bool levels, bool procedural = false)
+{
+    GLFWwindow* window = tessellate ? openWindow(4, 0) : openWindow();
+    
+    GLuint64 NInds = 0;
+    if(procedural){
+        oglWrap::createProcedural();
+        procOrder = order;
+    }
+    else if(adaptiveOrder >= 0) NInds = uploadAdaptive(0.0f);
+    else NInds = upload(order, levels);
+    // the arrow keys build in the background, keeping the topology lets each
+    // step up refine the order before
+    sphere::setKeepTopology(!levels);
+    std::vector<oglWrap::instance> insts = levels ? lod::field(count) : gpuBench::grid(count);
+    if(levels){
+        lodCounts = lod::bucket(lodLevels, insts, lodCam, 0.5f);
+        std::cout << "level of detail: " << lod::triangles(lodLevels, lodCounts) << " triangles a frame, spheres per order";
+        for(auto c: lodCounts) std::cout << ' ' << c;
+        std::cout << std::endl;
+    }
+    oglWrap::setInstances(insts);
     
     oglWrap::setUp();
     // shader is now compiled
     
     // setup shader variables
-    auto perspective = oglWrap::perspective(30.0f, 4.0f/3.0f, 0.1f, 180.0f);
-    oglWrap::setMat4("perspective", perspective.data());
-    auto rotateY = oglWrap::rotateY(0.0f);
-    oglWrap::setMat4("rotate", rotateY.data());
-   
-    // enable depth testing
-    glEnable(GL_DEPTH_TEST); 
+    setUniforms();
     
+    startTrace();
     GLfloat omega = 0.0f;
+    GLuint shown = order, wanted = order; // the order drawn and the one asked for
+    bool upHeld = false, downHeld = false;
     auto t_start = std::chrono::high_resolution_clock::now();
     while(!glfwWindowShouldClose(window)){
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             glfwSetWindowShouldClose(window, GL_TRUE); // end loop if escape key is pressed
-        // Clear the screen to black
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        // rotate on z axis
-        rotateY = oglWrap::rotateY(omega);
+        // the up and down arrows change the order, built in the background
+        const bool up = glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS;
+        const bool down = glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS;
+        if(tessellate){ // or the size of the triangles, halved or doubled
+            if(up && !upHeld && tessPixels > 1.0f) tessPixels /= 2.0f;
+            if(down && !downHeld && tessPixels < 256.0f) tessPixels *= 2.0f;
+            if(up != upHeld || down != downHeld) oglWrap::setFloat(uniTessPixels, tessPixels);
+        }
+        else{
+            if(up && !upHeld && wanted < maxKeyOrder) ++wanted;
+            if(down && !downHeld && wanted > 0) --wanted;
+        }
+        upHeld = up;
+        downHeld = down;
+        if(procedural && wanted != shown) procOrder = shown = wanted; // nothing to build
+        if(adaptiveOrder >= 0){
+            adaptiveOrder = shown = wanted;
+            NInds = uploadAdaptive(omega);
+        }
+        if(!building() && wanted != shown) nextBuild = sphere::buildAsync(wanted);
+        timing::beginFrame();
+        if(advanceBuild(NInds, shown)){
+            if(levels){
+                lodCounts = lod::bucket(lodLevels, insts, lodCam, 0.5f);
+                oglWrap::setInstances(insts); // sorted again, by their new levels
+            }
+            std::cout << "order " << shown << " swapped in" << std::endl;
+        }
+        drawFrame(omega, NInds, count);
         omega += 0.5;
-        oglWrap::setMat4("rotate", rotateY.data());        
-        
-        // set color and draw
-        oglWrap::setColor(0.1f, 0.2f, 0.5f);
-        oglWrap::draw(NInds, 0);
         
         // sleep until 50 milli seconds is reached
         auto t_now = std::chrono::high_resolution_clock::now();
         GLfloat time = std::chrono::duration_cast<std::chrono::duration<float>>(t_now - t_start).count();
-        // 20 frames per second, acceptable
-        std::this_thread::sleep_for(std::chrono::milliseconds(50 - (int) (time * 1000)));
+        {
+            timing::scope t("sleep");
+            // 20 frames per second, acceptable
+            std::this_thread::sleep_for(std::chrono::milliseconds(50 - (int) (time * 1000)));
+        }
         t_start = std::chrono::high_resolution_clock::now();
-        glfwSwapBuffers(window);
+        {
+            timing::scope t("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+        timing::endFrame();
     }   
+    if(nextBuild.valid()) nextBuild.wait(); // the builder is not left running at exit
+    endTrace();
     glfwTerminate();
 }
 
 
-int main(int argc, char *argv[])
+// runs the subcommand argv names, or the window, returns the exit status
+static int dispatch(int argc, char *argv[])
 {
-    if(argc != 2){
-        std::cout << "usage: " << argv[0] << " order, where order is a positve integer\n";
+    if(argc == 2 && std::string(argv[1]) == "check"){
+        // the baked low order tables against the runtime builder
+        return sphereTables::check() ? 0 : 1;
+    }
+    if(argc == 4 && std::string(argv[1]) == "headless"){
+        benchHeadless(atoi(argv[2]), atoi(argv[3]));
+        return 0;
+    }
+    if(argc == 3 && std::string(argv[1]) == "acmr"){
+        vcacheReport(atoi(argv[2]));
+        return 0;
+    }
+    if(argc == 5 && std::string(argv[1]) == "bench-instances"){
+        benchInstances(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+        return 0;
+    }
+    if(argc == 5 && std::string(argv[1]) == "bench-lod"){
+        benchLod(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+        return 0;
+    }
+    if(argc == 4 && std::string(argv[1]) == "formats"){
+        benchFormats(atoi(argv[2]), atoi(argv[3]));
+        return 0;
+    }
+    if((argc == 3 || argc == 4) && std::string(argv[1]) == "export"){
+        exportMesh(atoi(argv[2]), argc == 4 ? argv[3] : ".");
+        return 0;
+    }
+    if(argc == 5 && std::string(argv[1]) == "bench-swap"){
+        benchSwap(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+        return 0;
+    }
+    if(argc == 4 && std::string(argv[1]) == "adaptive"){
+        adaptiveReport(atoi(argv[2]), atof(argv[3]));
+        return 0;
+    }
+    if(argc == 3 && std::string(argv[1]) == "bench-refine"){
+        benchRefine(atoi(argv[2]));
+        return 0;
+    }
+    if(argc == 3 && std::string(argv[1]) == "check-refine"){
+        return checkRefine(atoi(argv[2])) ? 0 : 1;
+    }
+    if(argc == 3 && std::string(argv[1]) == "check-procedural"){
+        return checkProcedural(atoi(argv[2])) ? 0 : 1;
+    }
+    if(argc == 4 && std::string(argv[1]) == "bench-procedural"){
+        benchProcedural(atoi(argv[2]), atoi(argv[3]));
+        return 0;
+    }
+    if(argc == 4 && std::string(argv[1]) == "bench-tess"){
+        benchTess(atoi(argv[2]), atoi(argv[3]));
+        return 0;
+    }
+    if(argc == 4 && std::string(argv[1]) == "bench-locate"){
+        benchLocate(atoi(argv[2]), atoi(argv[3]));
+        return 0;
+    }
+    if(argc == 3 && std::string(argv[1]) == "bench-index"){
+        benchIndex(atoi(argv[2]));
+        return 0;
+    }
+    const bool levels = argc == 4 && std::string(argv[1]) == "lod";
+    const bool procedural = (argc == 3 || argc == 4) && std::string(argv[1]) == "procedural";
+    tessellate = (argc == 3 || argc == 4) && std::string(argv[1]) == "tess";
+    const bool adaptive = argc == 3 && std::string(argv[1]) == "adaptive";
+    if(argc != 2 && !(argc == 3 && std::isdigit(argv[1][0])) && !levels && !procedural && !tessellate && !adaptive){
+        std::cout << "usage: " << argv[0] << " order [count], where order is a positve integer\n";
         std::cout << "which represents how many times the triangles are divided into smaller ones\n";
+        std::cout << "and count spheres are drawn instanced\n";
+        std::cout << "   or: " << argv[0] << " check, to compare the baked in meshes with the builder\n";
+        std::cout << "   or: " << argv[0] << " bench-index order, to time 16 against 32 bit indices\n";
+        std::cout << "   or: " << argv[0] << " acmr order, vertex cache efficiency up to order\n";
+        std::cout << "   or: " << argv[0] << " headless order frames, offscreen frame times up to order\n";
+        std::cout << "   or: " << argv[0] << " bench-instances order count frames, draw calls against instancing\n";
+        std::cout << "   or: " << argv[0] << " bench-refine order, building each order afresh against refining\n";
+        std::cout << "   or: " << argv[0] << " check-refine order, refined spheres against fresh builds up to order\n";
+        std::cout << "   or: " << argv[0] << " formats order frames, size, accuracy and speed of the vertex layouts\n";
+        std::cout << "   or: " << argv[0] << " export order [dir], writes PLY, glTF and raw files\n";
+        std::cout << "   or: " << argv[0] << " bench-swap from to frames, changing order inline against in the background\n";
+        std::cout << "   or: " << argv[0] << " adaptive order [distance], view dependent subdivision up to order, drawn\n";
+        std::cout << "       as the sphere turns, or with distance the mesh for a camera that far away is reported\n";
+        std::cout << "   or: " << argv[0] << " procedural order [count], drawn from gl_VertexID with no vertex buffers\n";
+        std::cout << "   or: " << argv[0] << " check-procedural order, the procedural triangles against the builder's\n";
+        std::cout << "   or: " << argv[0] << " bench-procedural order frames, stored against procedural vertices\n";
+        std::cout << "   or: " << argv[0] << " tess pixels [count], the order 1 sphere tessellated to edges pixels long\n";
+        std::cout << "   or: " << argv[0] << " bench-tess order frames, CPU built meshes against tessellation\n";
+        std::cout << "   or: " << argv[0] << " bench-locate order queries, finding triangles through the tree against brute force\n";
+        std::cout << "   or: " << argv[0] << " lod order count, count spheres with level of detail up to order\n";
+        std::cout << "   or: " << argv[0] << " bench-lod order count frames, the top order against level of detail\n";
         return 0;
     }
+    if(levels) run(atoi(argv[2]), atoi(argv[3]), true);
+    else if(procedural) run(atoi(argv[2]), argc == 4 ? atoi(argv[3]) : 0, false, true);
+    else if(tessellate){
+        tessPixels = std::max(GLfloat(atof(argv[2])), 1.0f);
+        run(1, argc == 4 ? atoi(argv[3]) : 0, false);
+    }
+    else if(adaptive){
+        adaptiveOrder = std::min(GLuint(atoi(argv[2])), sphere::maxn);
+        run(adaptiveOrder, 0, false);
+    }
+    else run(atoi(argv[1]), argc == 3 ? atoi(argv[2]) : 0, false);
+    return 0;
+}
+
+// every subcommand runs inside the try, so its errors are reported
+int main(int argc, char *argv[])
+{
     try{ 
-        run(atoi(argv[1]));
+        return dispatch(argc, argv);
     }
-    catch (std::ifstream::failure e) {
+    catch (const std::ifstream::failure &e) {
         std::cerr << "ifstream file error: " << e.what() << std::endl;
         return 1;
     }
@@ -0,0 +1,211 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "meshCache.hpp"
+#include "simdNorm.hpp"
+
+static const char magic[8] = {'S', 'P', 'H', 'M', 'E', 'S', 'H', '\0'};
+static const std::size_t blockAlign = 64;
+static const std::uint32_t vcFlag = 0x100;
+
+struct header
+{
+    char magic[8];
+    char kernel[8]; // simdNorm::name() of the build, the vertices differ in the last bits
+    std::uint32_t version;
+    std::uint32_t order;
+    std::uint32_t layout; // vertLayout, plus vcFlag
+    std::uint32_t floatsPerVert;
+    std::uint64_t nFloats; // length of the vertex block
+    std::uint64_t nInds; // length of the index block
+    std::uint64_t vertOffset, indOffset; // from the start of the file
+    std::uint64_t checksum; // over the header, with this zeroed, and both blocks
+};
+static_assert(sizeof(header) == 72, "mesh cache header must be 72 bytes");
+
+static std::size_t roundUp(std::size_t n)
+{
+    return (n + blockAlign - 1) / blockAlign * blockAlign;
+}
+
+static const char* layoutName(vertLayout layout)
+{
+    return layout == vertLayout::pos ? "pos" : "posnorm";
+}
+
+static GLuint floatsPerVert(vertLayout layout)
+{
+    return layout == vertLayout::pos ? 3 : 6;
+}
+
+// 64 bit hash, a word at a time, chained from h
+std::uint64_t meshCache::hash(const void *data, std::size_t len, std::uint64_t h)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    const std::uint64_t mul = 0x9E3779B97F4A7C15ull;
+    std::uint64_t w;
+    
+    for(; len >= 8; len -= 8, p += 8){
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * mul;
+        h ^= h >> 29;
+    }
+    for(; len > 0; --len, ++p) h = (h ^ *p) * mul;
+    return h ^ (h >> 32);
+}
+
+static std::uint64_t checksum(header hd, const void *verts, const void *inds)
+{
+    hd.checksum = 0;
+    std::uint64_t h = meshCache::hash(&hd, sizeof(hd));
+    h = meshCache::hash(verts, hd.nFloats * sizeof(GLfloat), h);
+    return meshCache::hash(inds, hd.nInds * sizeof(GLuint), h);
+}
+
+static std::string fileName(GLuint order, vertLayout layout, bool vcOrder)
+{
+    std::ostringstream oss;
+    oss << "sphere-v" << meshCache::version << "-o" << order << '-' << layoutName(layout) << '-' << simdNorm::name();
+    oss << (vcOrder ? "-vc.mesh" : ".mesh");
+    return oss.str();
+}
+
+std::string meshCache::dir()
+{
+    const char *env = std::getenv("SPHERE_CACHE_DIR");
+    if(env && *env) return env;
+    env = std::getenv("XDG_CACHE_HOME");
+    if(env && *env) return std::string(env) + "/opengl-sphere";
+    env = std::getenv("HOME");
+    if(env && *env) return std::string(env) + "/.cache/opengl-sphere";
+    return "/tmp/opengl-sphere";
+}
+
+meshCache::mapped::mapped(void *p, std::size_t len, bufView<GLfloat> v, bufView<GLuint> i):
+    addr(p), bytes(len), verts(v), inds(i)
+{
+}
+
+meshCache::mapped::~mapped()
+{
+    munmap(addr, bytes);
+}
+
+// maps the cached file and checks it, any mismatch counts as a miss
+std::unique_ptr<meshCache::mapped> meshCache::load(GLuint order, vertLayout layout, bool vcOrder)
+{
+    const std::string name = dir() + '/' + fileName(order, layout, vcOrder);
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return nullptr;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(header)){
+        close(fd);
+        return nullptr;
+    }
+    const std::size_t len = st.st_size;
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) return nullptr;
+    
+    const char *base = static_cast<const char*>(addr);
+    header hd;
+    std::memcpy(&hd, base, sizeof(hd));
+    const bool ok = std::memcmp(hd.magic, magic, sizeof(magic)) == 0
+        && std::strncmp(hd.kernel, simdNorm::name(), sizeof(hd.kernel)) == 0
+        && hd.version == version && hd.order == order
+        && hd.layout == (GLuint(layout) | (vcOrder ? vcFlag : 0)) && hd.floatsPerVert == floatsPerVert(layout)
+        && hd.vertOffset == roundUp(sizeof(header))
+        && hd.indOffset == roundUp(hd.vertOffset + hd.nFloats * sizeof(GLfloat))
+        && hd.indOffset + hd.nInds * sizeof(GLuint) == len
+        && checksum(hd, base + hd.vertOffset, base + hd.indOffset) == hd.checksum;
+    if(!ok){
+        std::cerr << "meshCache: ignoring invalid cache file " << name << std::endl;
+        munmap(addr, len);
+        return nullptr;
+    }
+    bufView<GLfloat> verts(reinterpret_cast<const GLfloat*>(base + hd.vertOffset), hd.nFloats);
+    bufView<GLuint> inds(reinterpret_cast<const GLuint*>(base + hd.indOffset), hd.nInds);
+    return std::make_unique<mapped>(addr, len, verts, inds);
+}
+
+// false when the data could not all be written
+static bool writeAll(int fd, const void *data, std::size_t len)
+{
+    const char *p = static_cast<const char*>(data);
+    
+    while(len > 0){
+        ssize_t n = write(fd, p, len);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// writes a temporary file next to the final one then renames it into place,
+// rename is atomic so concurrent readers and writers only see whole files.
+// A cache fails soft, on a full disk or an unwritable directory the
+// temporary file is removed and the caller carries on without it
+bool meshCache::writeFile(const std::string &file, const std::vector<bufView<char>> &parts)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir(), ec);
+    const std::string name = dir() + '/' + file;
+    std::string tmp = name + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if(fd < 0) return false;
+    bool ok = true;
+    for(auto &part: parts) ok = ok && writeAll(fd, part.data(), part.size());
+    ok = ok && fchmod(fd, 0644) == 0 && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    ok = ok && rename(tmp.c_str(), name.c_str()) == 0;
+    if(!ok) unlink(tmp.c_str());
+    return ok;
+}
+
+void meshCache::store(GLuint order, vertLayout layout, bool vcOrder, bufView<GLfloat> verts, bufView<GLuint> inds)
+{
+    header hd = {};
+    std::memcpy(hd.magic, magic, sizeof(magic));
+    std::strncpy(hd.kernel, simdNorm::name(), sizeof(hd.kernel) - 1);
+    hd.version = version;
+    hd.order = order;
+    hd.layout = GLuint(layout) | (vcOrder ? vcFlag : 0);
+    hd.floatsPerVert = floatsPerVert(layout);
+    hd.nFloats = verts.size();
+    hd.nInds = inds.size();
+    hd.vertOffset = roundUp(sizeof(header));
+    hd.indOffset = roundUp(hd.vertOffset + hd.nFloats * sizeof(GLfloat));
+    hd.checksum = checksum(hd, verts.data(), inds.data());
+    
+    const char zeros[blockAlign] = {};
+    const std::size_t vertBytes = verts.size() * sizeof(GLfloat);
+    const std::vector<bufView<char>> parts = {
+        {reinterpret_cast<const char*>(&hd), sizeof(hd)},
+        {zeros, hd.vertOffset - sizeof(hd)},
+        {reinterpret_cast<const char*>(verts.data()), vertBytes},
+        {zeros, hd.indOffset - hd.vertOffset - vertBytes},
+        {reinterpret_cast<const char*>(inds.data()), inds.size() * sizeof(GLuint)} };
+    if(!writeFile(fileName(order, layout, vcOrder), parts))
+        std::cerr << "meshCache: warning, cannot write to " << dir() << ", mesh not cached" << std::endl;
+}
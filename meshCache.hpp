@@ -0,0 +1,52 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef meshCacheDec
+#define meshCacheDec
+
+#include <cstdint>
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
+// On disk cache of built meshes, one file per order, vertex layout and
+// simdNorm kernel, as the kernels round the last bit of a vertex differently.
+// A file is a 72 byte header, the vertex block then the index block, each
+// block starts on a 64 byte boundary. Files are written under a temporary
+// name and renamed into place, so readers only ever see complete files.
+namespace meshCache
+{
+    const GLuint version = 2; // bump whenever the builder's output changes
+    
+    // a cached mesh mapped read only, unmapped when destroyed
+    class mapped
+    {
+    public:
+        mapped(void *p, std::size_t len, bufView<GLfloat> v, bufView<GLuint> i);
+        ~mapped();
+        mapped(const mapped&) = delete;
+        mapped& operator=(const mapped&) = delete;
+        bufView<GLfloat> GetVerts(){ return verts; }
+        bufView<GLuint> GetInds(){ return inds; }
+    private:
+        void *addr;
+        std::size_t bytes;
+        bufView<GLfloat> verts;
+        bufView<GLuint> inds;
+    };
+    
+    std::string dir(); // $SPHERE_CACHE_DIR, else $XDG_CACHE_HOME or ~/.cache
+    // vcOrder marks meshes reordered for the vertex cache
+    std::unique_ptr<mapped> load(GLuint order, vertLayout layout, bool vcOrder); // nullptr on a miss
+    void store(GLuint order, vertLayout layout, bool vcOrder, bufView<GLfloat> verts, bufView<GLuint> inds);
+    
+    // shared with the other caches kept in dir()
+    std::uint64_t hash(const void *data, std::size_t len, std::uint64_t h = 0xcbf29ce484222325ull);
+    // writes the parts one after another to dir()/name, atomically, false with
+    // nothing left behind when it cannot, it never throws
+    bool writeFile(const std::string &name, const std::vector<bufView<char>> &parts);
+}
+
+#endif
@@ -0,0 +1,215 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "meshExport.hpp"
+
+namespace
+{
+    // a file written through one buffer of meshExport::chunk bytes, blocks
+    // at least that big skip the buffer and go out with it in one writev()
+    class writer
+    {
+    public:
+        writer(const std::string &file);
+        ~writer();
+        writer(const writer&) = delete;
+        writer& operator=(const writer&) = delete;
+        void put(const void *p, std::size_t n);
+        char* reserve(std::size_t n); // room for n bytes, n <= chunk, then commit()
+        void commit(std::size_t n){ used += n; }
+        void finish(); // flushes and closes, errors are thrown
+        GLuint64 written(){ return total; }
+    private:
+        void writeAll(struct iovec *iov, int n);
+        std::string name;
+        int fd;
+        std::vector<char> buf;
+        std::size_t used = 0;
+        GLuint64 total = 0;
+    };
+}
+
+writer::writer(const std::string &file):name(file), buf(meshExport::chunk)
+{
+    fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) throw std::runtime_error("Error: meshExport, cannot create " + file + ", " + std::strerror(errno));
+}
+
+writer::~writer()
+{
+    if(fd >= 0) close(fd);
+}
+
+// short writes carry on from where they stopped
+void writer::writeAll(struct iovec *iov, int n)
+{
+    while(n > 0){
+        ssize_t w = writev(fd, iov, n);
+        if(w < 0 && errno == EINTR) continue;
+        if(w < 0) throw std::runtime_error("Error: meshExport, failed writing " + name + ", " + std::strerror(errno));
+        total += w;
+        while(n > 0 && std::size_t(w) >= iov -> iov_len){
+            w -= iov -> iov_len;
+            ++iov;
+            --n;
+        }
+        if(n > 0){
+            iov -> iov_base = static_cast<char*>(iov -> iov_base) + w;
+            iov -> iov_len -= w;
+        }
+    }
+}
+
+void writer::put(const void *p, std::size_t n)
+{
+    if(n < buf.size()){
+        std::memcpy(reserve(n), p, n);
+        commit(n);
+        return;
+    }
+    struct iovec iov[2] = {{buf.data(), used}, {const_cast<void*>(p), n}};
+    used = 0;
+    writeAll(iov, 2);
+}
+
+char* writer::reserve(std::size_t n)
+{
+    if(used + n > buf.size()){
+        struct iovec iov = {buf.data(), used};
+        used = 0;
+        writeAll(&iov, 1);
+    }
+    return buf.data() + used;
+}
+
+void writer::finish()
+{
+    struct iovec iov = {buf.data(), used};
+    used = 0;
+    writeAll(&iov, 1);
+    const int f = fd;
+    fd = -1;
+    if(close(f) != 0) throw std::runtime_error("Error: meshExport, failed closing " + name);
+}
+
+static bool littleEndian()
+{
+    const std::uint16_t one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// the normals are the positions, on the unit sphere, so each vertex is
+// written twice over, and each face gets its count of 3 in front
+meshExport::result meshExport::ply(const std::string &name, bufView<GLfloat> verts, bufView<GLuint> inds)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    const std::size_t nVerts = verts.size() / 3, nTri = inds.size() / 3;
+    std::ostringstream hd;
+    hd << "ply\nformat " << (littleEndian() ? "binary_little_endian" : "binary_big_endian") << " 1.0\n";
+    hd << "comment unit sphere, normals equal the positions\n";
+    hd << "element vertex " << nVerts << "\n";
+    for(const char *p: {"x", "y", "z", "nx", "ny", "nz"}) hd << "property float " << p << "\n";
+    hd << "element face " << nTri << "\nproperty list uchar uint vertex_indices\nend_header\n";
+    const std::string header = hd.str();
+
+    writer out(name + ".ply");
+    out.put(header.data(), header.size());
+    const std::size_t vertBytes = 6 * sizeof(GLfloat), faceBytes = 1 + 3 * sizeof(GLuint);
+    for(std::size_t i=0; i<nVerts; ){
+        const std::size_t n = std::min(nVerts - i, chunk / vertBytes);
+        char *p = out.reserve(n * vertBytes);
+        for(std::size_t j=0; j<n; ++j, ++i, p+=vertBytes){
+            std::memcpy(p, &verts[3 * i], 3 * sizeof(GLfloat));
+            std::memcpy(p + 3 * sizeof(GLfloat), &verts[3 * i], 3 * sizeof(GLfloat));
+        }
+        out.commit(n * vertBytes);
+    }
+    for(std::size_t i=0; i<nTri; ){
+        const std::size_t n = std::min(nTri - i, chunk / faceBytes);
+        char *p = out.reserve(n * faceBytes);
+        for(std::size_t j=0; j<n; ++j, ++i, p+=faceBytes){
+            *p = 3;
+            std::memcpy(p + 1, &inds[3 * i], 3 * sizeof(GLuint));
+        }
+        out.commit(n * faceBytes);
+    }
+    out.finish();
+    return {name + ".ply", out.written(), msSince(t0)};
+}
+
+// one buffer with the positions then the indices, both written straight
+// from the mesh, the normals share the positions' accessor
+meshExport::result meshExport::gltf(const std::string &name, bufView<GLfloat> verts, bufView<GLuint> inds)
+{
+    if(!littleEndian()) throw std::runtime_error("Error: meshExport::gltf(), glTF buffers are little endian");
+    auto t0 = std::chrono::steady_clock::now();
+    const std::size_t vertBytes = verts.size() * sizeof(GLfloat), indBytes = inds.size() * sizeof(GLuint);
+    if(verts.size() < 3) throw std::runtime_error("Error: meshExport::gltf(), no vertices");
+    GLfloat lo[3] = {verts[0], verts[1], verts[2]}, hi[3] = {verts[0], verts[1], verts[2]}; // the accessor needs the bounds
+    for(std::size_t i=3; i<verts.size(); i+=3){
+        for(int k=0; k<3; ++k){
+            lo[k] = std::min(lo[k], verts[i + k]);
+            hi[k] = std::max(hi[k], verts[i + k]);
+        }
+    }
+    writer bin(name + ".bin");
+    bin.put(verts.data(), vertBytes);
+    bin.put(inds.data(), indBytes);
+    bin.finish();
+
+    const std::string binName = name.substr(name.find_last_of('/') + 1) + ".bin"; // next to the .gltf
+    std::ostringstream js;
+    js.precision(9);
+    js << "{\n  \"asset\": {\"version\": \"2.0\", \"generator\": \"OpenGL-sphere\"},\n";
+    js << "  \"scene\": 0,\n  \"scenes\": [{\"nodes\": [0]}],\n  \"nodes\": [{\"mesh\": 0}],\n";
+    js << "  \"meshes\": [{\"primitives\": [{\"attributes\": {\"POSITION\": 0, \"NORMAL\": 0}, \"indices\": 1, \"mode\": 4}]}],\n";
+    js << "  \"buffers\": [{\"uri\": \"" << binName << "\", \"byteLength\": " << vertBytes + indBytes << "}],\n";
+    js << "  \"bufferViews\": [\n";
+    js << "    {\"buffer\": 0, \"byteOffset\": 0, \"byteLength\": " << vertBytes << ", \"byteStride\": 12, \"target\": 34962},\n";
+    js << "    {\"buffer\": 0, \"byteOffset\": " << vertBytes << ", \"byteLength\": " << indBytes << ", \"target\": 34963}\n  ],\n";
+    js << "  \"accessors\": [\n";
+    js << "    {\"bufferView\": 0, \"componentType\": 5126, \"count\": " << verts.size() / 3 << ", \"type\": \"VEC3\", ";
+    js << "\"min\": [" << lo[0] << ", " << lo[1] << ", " << lo[2] << "], \"max\": [" << hi[0] << ", " << hi[1] << ", " << hi[2] << "]},\n";
+    js << "    {\"bufferView\": 1, \"componentType\": 5125, \"count\": " << inds.size() << ", \"type\": \"SCALAR\"}\n  ]\n}\n";
+    const std::string json = js.str();
+    writer gl(name + ".gltf");
+    gl.put(json.data(), json.size());
+    gl.finish();
+    return {name + ".gltf", bin.written() + gl.written(), msSince(t0)};
+}
+
+// a 32 byte header, "SPHRAW1" then the vertex and index counts as 64 bit
+// integers and 8 bytes of zeros, then the floats and indices as in memory
+meshExport::result meshExport::raw(const std::string &name, bufView<GLfloat> verts, bufView<GLuint> inds)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    char header[32] = "SPHRAW1";
+    const std::uint64_t counts[2] = {verts.size() / 3, inds.size()};
+    std::memcpy(header + 8, counts, sizeof(counts));
+    writer out(name + ".raw");
+    out.put(header, sizeof(header));
+    out.put(verts.data(), verts.size() * sizeof(GLfloat));
+    out.put(inds.data(), inds.size() * sizeof(GLuint));
+    out.finish();
+    return {name + ".raw", out.written(), msSince(t0)};
+}
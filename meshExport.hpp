@@ -0,0 +1,32 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef meshExportDec
+#define meshExportDec
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
+// Writes a mesh to files other programs can read. The data is streamed
+// out, large blocks straight from the mesh and reformatted data through one
+// fixed size buffer, so no second copy of the mesh is ever made.
+namespace meshExport
+{
+    const std::size_t chunk = 4 << 20; // bytes buffered before a write
+
+    struct result
+    {
+        std::string file;
+        GLuint64 bytes; // in every file written
+        double ms;
+    };
+
+    // name is the path without an extension, verts are xyz per vertex on the unit sphere
+    result ply(const std::string &name, bufView<GLfloat> verts, bufView<GLuint> inds); // binary, with normals
+    result gltf(const std::string &name, bufView<GLfloat> verts, bufView<GLuint> inds); // .gltf and .bin
+    result raw(const std::string &name, bufView<GLfloat> verts, bufView<GLuint> inds); // header, vertices, indices
+}
+
+#endif
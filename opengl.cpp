@@ -12,72 +12,191 @@
 #include <sstream>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <unordered_map>
 
 #include "opengl.hpp"
+#include "shaderCache.hpp"
+#include "vertFormat.hpp"
 
 static const GLfloat pi = 3.1415926535897932f;
-static GLuint shaderProgram;
-static GLint uniColor;
-static GLuint vao, vbo, ebo;
+static GLuint shaderProgram; // the one in use
+static std::array<GLuint, 5> programs = {}; // one per vertLayout, built when first drawn with
+static vertLayout programLayout = vertLayout::pos;
+static GLuint tessProgram; // drawPatches()'s, built when first drawn with
+static bool tessActive = false; // it is in use, in place of programs[programLayout]
+static GLuint64 nCalls; // GL calls made per frame, see glCalls()
 
+// every active uniform, resolved once in setUp(), members of the frame
+// block are kept in frameData and uploaded with one call before a draw
+namespace
+{
+    struct uniformInfo
+    {
+        GLint location; // -1 for block members
+        GLint offset; // in the frame block, -1 for plain uniforms
+    };
+}
+static std::vector<uniformInfo> uniforms; // indexed by oglWrap::uniformId
+static std::unordered_map<std::string, oglWrap::uniformId> uniformIds;
+static oglWrap::uniformId uniColor = -1, uniOrder = -1; // set by setColor() and the procedural draws
+static std::vector<unsigned char> frameData;
+static bool frameDirty = false;
+static GLuint ubo;
+static GLfloat clearRGB[3] = {-1.0f, -1.0f, -1.0f}; // the clear colour GL has
+static GLuint vao, vbo, ebo, ibo; // ibo holds the instances
+static GLuint instBase; // the instance the attribute pointers start at
+static std::size_t vboBytes; // size of the vertex buffer
+static vertLayout vboLayout;
+static GLenum indexType = GL_UNSIGNED_INT; // of the element buffer
+static std::size_t indexSize = sizeof(GLuint);
+static bool instancing = false; // attributes 2 and 3 come from ibo
 
-// Put shaders in files: vertex.shader, fragment.shader
-static void shaders()
+// the buffers being staged by stageBuff(), and how far through they are
+namespace
 {
-    std::string vertexCode, fragmentCode;
-    // First read source code from files into the two strings declared directly above
+    struct staged
     {
-        std::ifstream fin;
-        std::stringstream vShaderStream, fShaderStream;
-        
-        fin.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        // vertex shader first
-        fin.open("vertex.shader");
-        vShaderStream << fin.rdbuf();
-        fin.close();
-        vertexCode = vShaderStream.str();
-        // fragment shader
-        fin.open("fragment.shader");
-        fShaderStream << fin.rdbuf();
-        fin.close();
-        fragmentCode = fShaderStream.str();
+        GLuint vao, vbo, ebo;
+        const GLfloat *verts;
+        const unsigned char *inds;
+        std::size_t vertBytes, indBytes, done; // done counts vertex bytes, as encoded, then index bytes
+        vertLayout layout;
+        GLenum indexType;
+        std::size_t indexSize;
+    };
+}
+static staged back;
+
+
+// the shader sources built into the binary, vertexSource, fragmentSource,
+// tessControlSource, tessEvalSource and frameSource, made by the makefile
+// from the .shader files
+#include "shaders.inc"
+
+// the sources are read from $SPHERE_SHADER_DIR when it is set, so shaders
+// can be edited without a rebuild, otherwise the built in copies are used
+static std::string shaderFile(const char *dir, const char *name)
+{
+    std::ifstream fin;
+    std::stringstream stream;
+    fin.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    fin.open(std::string(dir) + "/" + name);
+    stream << fin.rdbuf();
+    return stream.str();
+}
+
+static std::string shaderSource(const char *name, const char *builtIn)
+{
+    const char *dir = std::getenv("SPHERE_SHADER_DIR");
+    if(!dir || !*dir) return builtIn;
+    return shaderFile(dir, name);
+}
+
+// the source with text put after its #version line
+static std::string afterVersion(std::string code, const std::string &text)
+{
+    const std::size_t version = code.find("#version");
+    const std::size_t eol = version == std::string::npos ? version : code.find('\n', version);
+    if(eol == std::string::npos) throw std::runtime_error("Error: afterVersion(), shader has no #version line");
+    code.insert(eol + 1, text);
+    return code;
+}
+
+// every stage declares the frame block from the one source, frame.shader
+static std::string withFrame(const std::string &code)
+{
+    return afterVersion(code, shaderSource("frame.shader", frameSource));
+}
+
+static void shaderSources(std::string &vertexCode, std::string &fragmentCode)
+{
+    vertexCode = withFrame(shaderSource("vertex.shader", vertexSource));
+    fragmentCode = withFrame(shaderSource("fragment.shader", fragmentSource));
+}
+
+// the tessellation control and evaluation stages, from the same place
+static void tessSources(std::string &controlCode, std::string &evalCode)
+{
+    controlCode = withFrame(shaderSource("tessControl.shader", tessControlSource));
+    evalCode = withFrame(shaderSource("tessEval.shader", tessEvalSource));
+}
+
+static GLuint compile(GLenum type, const std::string &code)
+{
+    GLuint shader = glCreateShader(type);
+    const char *src = code.c_str();
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    int success;
+    char infoLog[1024];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(!success){
+        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+        glDeleteShader(shader);
+        const char *kind = type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" :
+                           type == GL_TESS_CONTROL_SHADER ? "TESS_CONTROL" : "TESS_EVALUATION";
+        throw std::runtime_error("ERROR::SHADER::" + std::string(kind) + "::COMPILATION_FAILED\n" + std::string(infoLog));
+    }
+    return shader;
+}
+
+// the source with #define name put after its #version line
+static std::string withDefine(const std::string &code, const char *name)
+{
+    return afterVersion(code, "#define " + std::string(name) + "\n");
+}
+
+// the vertex shader for each layout, a #define after the #version line picks
+// how it reads the vertices, pos is the source as it stands
+static std::string variant(std::string code, vertLayout layout)
+{
+    const char *define = nullptr;
+    if(layout == vertLayout::posNorm) define = "POS_NORM";
+    if(layout == vertLayout::oct16) define = "OCT16";
+    if(layout == vertLayout::half) define = "HALF_FLOAT";
+    if(layout == vertLayout::procedural) define = "PROCEDURAL";
+    if(!define) return code;
+    return withDefine(code, define);
+}
+
+// the linked program comes from the program binary cache when it can,
+// otherwise it is compiled and linked then stored in the cache
+static void shaders(vertLayout layout)
+{
+    std::string vertexCode, fragmentCode;
+    shaderSources(vertexCode, fragmentCode);
+    vertexCode = variant(vertexCode, layout);
+    shaderProgram = programs[int(layout)] = shaderCache::load(vertexCode, fragmentCode);
+    programLayout = layout;
+    if(shaderProgram){
+        glUseProgram(shaderProgram);
+        return;
     }
     // Now compile and link the shaders
-    {
-        // Create and compile the vertex shader
-        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        const char *vCode = vertexCode.c_str();
-        glShaderSource(vertexShader, 1, &vCode, NULL);
-        glCompileShader(vertexShader);
-        int success;
+    GLuint vertexShader = compile(GL_VERTEX_SHADER, vertexCode);
+    GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentCode);
+    // Link the vertex and fragment shader into a shader program
+    shaderProgram = programs[int(layout)] = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glBindFragDataLocation(shaderProgram, 0, "outColor");
+    glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(shaderProgram);
+    glDeleteShader(fragmentShader);
+    glDeleteShader(vertexShader);
+    int success;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if(!success){
         char infoLog[1024];
-        glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-        if(!success){
-            glGetShaderInfoLog(vertexShader, 1024, NULL, infoLog);
-            std::string str = "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" + std::string(infoLog);
-            throw std::runtime_error(str);
-        }   
-        // Create and compile the fragment shader
-        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        const char *fCode = fragmentCode.c_str();
-        glShaderSource(fragmentShader, 1, &fCode, NULL);
-        glCompileShader(fragmentShader);
-        glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-        if(!success){
-            glGetShaderInfoLog(fragmentShader, 1024, NULL, infoLog);
-            std::string str = "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" + std::string(infoLog);
-            throw std::runtime_error(str);
-        }     
-        // Link the vertex and fragment shader into a shader program
-        shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glBindFragDataLocation(shaderProgram, 0, "outColor");
-        glLinkProgram(shaderProgram);
-        glDeleteShader(fragmentShader);
-        glDeleteShader(vertexShader);
-        glUseProgram(shaderProgram);
+        glGetProgramInfoLog(shaderProgram, 1024, NULL, infoLog);
+        throw std::runtime_error("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" + std::string(infoLog));
     }
+    shaderCache::store(shaderProgram, vertexCode, fragmentCode);
+    glUseProgram(shaderProgram);
 }
 
 static std::vector<GLfloat> pvec(16);
@@ -139,21 +258,197 @@ void oglWrap::info()
     std::cout << "OpenGL renderer string: " << glGetString(GL_RENDERER) << std::endl;
 }
 
+// attributes 2 and 3 are per instance, with their arrays off every vertex
+// reads the current generic values, which default to a single sphere at the origin
+static const oglWrap::instance single = {{0.0f, 0.0f, 0.0f}, 1.0f, {1.0f, 1.0f, 1.0f}};
+
+// looks up every active uniform and where the frame block's members sit,
+// the block is std140 and row major so the matrices are copied as they are
+static void registerUniforms()
+{
+    uniforms.clear();
+    uniformIds.clear();
+    GLint n = 0;
+    glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &n);
+    for(GLuint i=0; i<GLuint(n); ++i){
+        char name[256];
+        GLint size, block, offset;
+        GLenum type;
+        glGetActiveUniform(shaderProgram, i, sizeof(name), nullptr, &size, &type, name);
+        glGetActiveUniformsiv(shaderProgram, 1, &i, GL_UNIFORM_BLOCK_INDEX, &block);
+        glGetActiveUniformsiv(shaderProgram, 1, &i, GL_UNIFORM_OFFSET, &offset);
+        uniformIds[name] = uniforms.size();
+        if(block < 0) uniforms.push_back({glGetUniformLocation(shaderProgram, name), -1});
+        else uniforms.push_back({-1, offset});
+    }
+    uniColor = oglWrap::uniform("triangleColor");
+    uniOrder = oglWrap::uniform("sphereOrder");
+    
+    // the frame block is bound to binding point 0 for the whole run
+    GLuint block = glGetUniformBlockIndex(shaderProgram, "frame");
+    if(block == GL_INVALID_INDEX) throw std::runtime_error("Error: registerUniforms(), no frame uniform block");
+    GLint bytes = 0;
+    glGetActiveUniformBlockiv(shaderProgram, block, GL_UNIFORM_BLOCK_DATA_SIZE, &bytes);
+    glUniformBlockBinding(shaderProgram, block, 0);
+    frameData.assign(bytes, 0);
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo);
+    frameDirty = true;
+}
+
 void oglWrap::setUp()
 {
-    shaders();
-    uniColor = glGetUniformLocation(shaderProgram, "triangleColor");
+    shaders(vertLayout::pos);
+    registerUniforms();
+    setInstance(single);
+}
+
+// the program for the layout of the buffers being drawn, the variants all
+// declare the same frame block so they share the block's buffer and offsets,
+// uniforms outside the block are only set in the pos program
+static void matchLayout()
+{
+    if(vboLayout == programLayout && !tessActive) return;
+    ++nCalls;
+    tessActive = false;
+    const GLuint p = programs[int(vboLayout)];
+    if(p){
+        shaderProgram = p;
+        programLayout = vboLayout;
+        glUseProgram(p);
+        return;
+    }
+    shaders(vboLayout);
+    GLuint block = glGetUniformBlockIndex(shaderProgram, "frame");
+    GLint bytes = 0;
+    if(block != GL_INVALID_INDEX) glGetActiveUniformBlockiv(shaderProgram, block, GL_UNIFORM_BLOCK_DATA_SIZE, &bytes);
+    if(std::size_t(bytes) != frameData.size())
+        throw std::runtime_error("Error: matchLayout(), the frame block differs between shader variants");
+    glUniformBlockBinding(shaderProgram, block, 0);
 }
 
 void oglWrap::close()
 {
-    glDeleteProgram(shaderProgram);
+    for(auto &p: programs){
+        glDeleteProgram(p);
+        p = 0;
+    }
+    glDeleteProgram(tessProgram);
+    tessProgram = 0;
+    tessActive = false;
+    shaderProgram = 0;
+    programLayout = vertLayout::pos;
+    glDeleteBuffers(1, &ubo);
+    ubo = 0;
+    uniforms.clear();
+    uniformIds.clear();
+    uniColor = uniOrder = -1;
+    clearRGB[0] = clearRGB[1] = clearRGB[2] = -1.0f; // the next context starts afresh
+    deleteBuff();
+}
+
+// the frame block goes to the GPU in one upload, only when it has changed
+static void flushFrame()
+{
+    if(!frameDirty) return;
+    ++nCalls;
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, frameData.size(), frameData.data());
+    frameDirty = false;
+}
+
+// clears colour and depth, the colour is only set when it changes
+void oglWrap::clear(GLfloat r, GLfloat g, GLfloat b)
+{
+    if(r != clearRGB[0] || g != clearRGB[1] || b != clearRGB[2]){
+        ++nCalls;
+        glClearColor(r, g, b, 1.0f);
+        clearRGB[0] = r;
+        clearRGB[1] = g;
+        clearRGB[2] = b;
+    }
+    ++nCalls;
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// GL calls made through oglWrap since the last reset, the count of a frame
+GLuint64 oglWrap::glCalls(bool reset)
+{
+    GLuint64 n = nCalls;
+    if(reset) nCalls = 0;
+    return n;
+}
+
+static void deleteStaged()
+{
+    glDeleteBuffers(1, &back.vbo);
+    glDeleteBuffers(1, &back.ebo);
+    glDeleteVertexArrays(1, &back.vao);
+    back = staged();
+}
+
+void oglWrap::deleteBuff()
+{
+    deleteStaged();
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ebo);
+    glDeleteBuffers(1, &ibo);
     glDeleteVertexArrays(1, &vao);
+    vbo = ebo = ibo = vao = 0;
+    vboBytes = 0;
+    instancing = false;
+}
+
+// points the vertex attributes at the vertex buffer bound to GL_ARRAY_BUFFER,
+// only posNorm has a normal of its own in attribute 1
+static void vertexPointers(vertLayout layout)
+{
+    const GLsizei stride = vertFormat::stride(layout);
+    switch(layout){
+        case vertLayout::pos:
+        case vertLayout::posNorm:
+            // position attribute
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+            break;
+        case vertLayout::oct16:
+            // read as integers, the shader scales them
+            glVertexAttribIPointer(0, 2, GL_SHORT, stride, (GLvoid*)0);
+            break;
+        case vertLayout::half:
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+            break;
+        case vertLayout::procedural:
+            throw std::runtime_error("Error: vertexPointers(), the procedural layout has no vertex buffer");
+    }
+    glEnableVertexAttribArray(0);
+    if(layout == vertLayout::posNorm){
+        // normal attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+    }
+}
+
+// vertices from vertex first on, into the buffer bound to target. The
+// float layouts are sent as they are, the compact ones are encoded straight
+// into the mapped buffer so no encoded copy is kept
+static void writeVerts(GLenum target, bufView<GLfloat> vertices, std::size_t first, vertLayout layout)
+{
+    const std::size_t nf = vertFormat::floats(layout), stride = vertFormat::stride(layout);
+    const std::size_t n = vertices.size() / nf - first;
+    if(n == 0) return;
+    if(layout == vertLayout::pos || layout == vertLayout::posNorm){
+        glBufferSubData(target, first * stride, n * stride, vertices.data() + first * nf);
+        return;
+    }
+    void *p = glMapBufferRange(target, first * stride, n * stride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if(!p) throw std::runtime_error("Error: writeVerts(), glMapBufferRange() failed");
+    vertFormat::encode(layout, vertices.data() + first * nf, n, p);
+    if(!glUnmapBuffer(target)) throw std::runtime_error("Error: writeVerts(), buffer contents lost while mapped");
 }
 
-void oglWrap::createBuff(std::vector<GLfloat> &vertices, std::vector<GLuint> &indices)
+// vertices are uploaded straight from the caller's buffer
+void oglWrap::createBuff(bufView<GLfloat> vertices, indView indices, vertLayout layout)
 {
     // Create Vertex Array Object
     glGenVertexArrays(1, &vao);
@@ -163,20 +458,53 @@ void oglWrap::createBuff(std::vector<GLfloat> &vertices, std::vector<GLuint> &in
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo); // and an element buffer object
     
-    // vertex data
+    // vertex data, the float layouts go straight from the caller's buffer
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    vboBytes = vertices.size() / vertFormat::floats(layout) * vertFormat::stride(layout);
+    vboLayout = layout;
+    const bool asIs = layout == vertLayout::pos || layout == vertLayout::posNorm;
+    glBufferData(GL_ARRAY_BUFFER, vboBytes, asIs ? vertices.data() : nullptr, GL_STATIC_DRAW);
+    if(!asIs) writeVerts(GL_ARRAY_BUFFER, vertices, 0, layout);
    
     // index data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo); // element buffer object
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes(), indices.data(), GL_STATIC_DRAW);
+    indexType = indices.type();
+    indexSize = indices.elemSize();
     // Specify the layout of the vertex data
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
-    // normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
+    vertexPointers(layout);
+}
+
+// for a refined sphere, the first keep floats of vertices are already on the
+// GPU and only the rest are sent. GL buffers cannot grow, so a larger one is
+// made and the old vertices copied across on the GPU. The indices all change
+// and are sent whole, returns the bytes sent
+GLuint64 oglWrap::growBuff(bufView<GLfloat> vertices, std::size_t keep, indView indices)
+{
+    const std::size_t nf = vertFormat::floats(vboLayout), stride = vertFormat::stride(vboLayout);
+    const std::size_t bytes = vertices.size() / nf * stride, keepBytes = keep / nf * stride;
+    if(keepBytes > vboBytes || keep > vertices.size())
+        throw std::runtime_error("Error: oglWrap::growBuff(), more vertices kept than uploaded");
+    glBindVertexArray(vao);
+    if(bytes > vboBytes){
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, keepBytes);
+        glDeleteBuffers(1, &vbo);
+        vbo = grown;
+        vboBytes = bytes;
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        vertexPointers(vboLayout);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    writeVerts(GL_ARRAY_BUFFER, vertices, keep / nf, vboLayout);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.bytes(), indices.data(), GL_STATIC_DRAW);
+    indexType = indices.type();
+    indexSize = indices.elemSize();
+    return bytes - keepBytes + indices.bytes();
 }
 
 
@@ -184,31 +512,347 @@ void oglWrap::createBuff(std::vector<GLfloat> &vertices, std::vector<GLuint> &in
 // offset: number of indices to offset by
 void oglWrap::draw(GLuint n, GLuint offset)
 {
-    glDrawElements(GL_TRIANGLES, n, GL_UNSIGNED_INT, (void*)(offset * sizeof(GLuint)));
+    matchLayout();
+    flushFrame();
+    ++nCalls;
+    glDrawElements(GL_TRIANGLES, n, indexType, (void*)(offset * indexSize));
 }
 
-// Wrapper functions to set the uniforms
-void oglWrap::setFloat(const std::string &name, GLfloat value)
+// points the instance attributes at instance first onwards, GL 3.3 has no
+// base instance for instanced draws so the pointers are moved instead
+static void instPointers(GLuint first)
 {
-    glUniform1f(glGetUniformLocation(shaderProgram, name.c_str()), value); 
+    const std::size_t base = first * sizeof(oglWrap::instance);
+    nCalls += 3;
+    glBindBuffer(GL_ARRAY_BUFFER, ibo);
+    // translation and scale
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(oglWrap::instance),
+        (GLvoid*)(base + offsetof(oglWrap::instance, pos)));
+    // colour
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(oglWrap::instance),
+        (GLvoid*)(base + offsetof(oglWrap::instance, color)));
+    instBase = first;
 }
 
-void oglWrap::setVec3(const std::string &name, GLfloat data[]) 
-{ 
-    GLint uni = glGetUniformLocation(shaderProgram, name.c_str());
-    glUniform3fv(uni, 1, data);
+// one value of attributes 2 and 3 per instance, for the bound vertex array
+static void instAttribs()
+{
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(3);
+    instancing = true;
 }
 
-void oglWrap::setMat4(const std::string &name, GLfloat data[])
+// instances for the current vertex array, call after createBuff(),
+// each call replaces the previous set
+void oglWrap::setInstances(bufView<instance> instances)
 {
-    GLint uni = glGetUniformLocation(shaderProgram, name.c_str());
-    glUniformMatrix4fv(uni, 1, GL_TRUE, data); // transpose is set to true
+    glBindVertexArray(vao);
+    if(instances.empty()){
+        glDisableVertexAttribArray(2);
+        glDisableVertexAttribArray(3);
+        setInstance(single);
+        instancing = false;
+        return;
+    }
+    if(!ibo) glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(instance), instances.data(), GL_STATIC_DRAW);
+    instPointers(0);
+    instAttribs();
 }
 
-void oglWrap::setColor(GLfloat x, GLfloat y, GLfloat z) 
-{  
-    glUniform3f(uniColor, x, y, z); 
+void oglWrap::setInstance(const instance &inst)
+{
+    nCalls += 2;
+    glVertexAttrib4f(2, inst.pos[0], inst.pos[1], inst.pos[2], inst.scale);
+    glVertexAttrib3fv(3, inst.color);
+}
+
+// one call draws nInstances spheres from the instances set last,
+// starting at instance first
+void oglWrap::drawInstanced(GLuint n, GLuint offset, GLuint nInstances, GLuint first)
+{
+    matchLayout();
+    flushFrame();
+    if(first != instBase) instPointers(first);
+    ++nCalls;
+    glDrawElementsInstanced(GL_TRIANGLES, n, indexType, (void*)(offset * indexSize), nInstances);
+}
+
+// the vertex shader with TESS, which hands the corners of the patches on,
+// the two tessellation stages and the fragment shader. The tessellation
+// sources are keyed with the vertex source in the program cache
+static void tessShaders()
+{
+    GLint major = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    if(major < 4) throw std::runtime_error("Error: tessShaders(), tessellation needs OpenGL 4.0");
+    std::string vertexCode, fragmentCode, controlCode, evalCode;
+    shaderSources(vertexCode, fragmentCode);
+    tessSources(controlCode, evalCode);
+    vertexCode = withDefine(vertexCode, "TESS");
+    const std::string key = vertexCode + controlCode + evalCode;
+    tessProgram = shaderCache::load(key, fragmentCode);
+    if(!tessProgram){
+        const GLuint stages[4] = {compile(GL_VERTEX_SHADER, vertexCode), compile(GL_TESS_CONTROL_SHADER, controlCode),
+                                  compile(GL_TESS_EVALUATION_SHADER, evalCode), compile(GL_FRAGMENT_SHADER, fragmentCode)};
+        tessProgram = glCreateProgram();
+        for(GLuint st: stages) glAttachShader(tessProgram, st);
+        glBindFragDataLocation(tessProgram, 0, "outColor");
+        glProgramParameteri(tessProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(tessProgram);
+        for(GLuint st: stages) glDeleteShader(st);
+        int success;
+        glGetProgramiv(tessProgram, GL_LINK_STATUS, &success);
+        if(!success){
+            char infoLog[1024];
+            glGetProgramInfoLog(tessProgram, 1024, NULL, infoLog);
+            glDeleteProgram(tessProgram);
+            tessProgram = 0;
+            throw std::runtime_error("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" + std::string(infoLog));
+        }
+        shaderCache::store(tessProgram, key, fragmentCode);
+    }
+    GLuint block = glGetUniformBlockIndex(tessProgram, "frame");
+    GLint bytes = 0;
+    if(block != GL_INVALID_INDEX) glGetActiveUniformBlockiv(tessProgram, block, GL_UNIFORM_BLOCK_DATA_SIZE, &bytes);
+    if(std::size_t(bytes) != frameData.size())
+        throw std::runtime_error("Error: tessShaders(), the frame block differs from the other shaders'");
+    glUniformBlockBinding(tessProgram, block, 0);
+}
+
+// the triangles of the buffer, n indices from offset, drawn as patches for
+// the tessellation stages to divide and push out onto the sphere, the
+// levels come from tessLevel, or tessPixels and tessScale, in the frame block
+void oglWrap::drawPatches(GLuint n, GLuint offset, GLuint nInstances)
+{
+    if(vboLayout != vertLayout::pos) throw std::runtime_error("Error: oglWrap::drawPatches(), the patches must have the pos layout");
+    if(!tessActive){
+        if(!tessProgram) tessShaders();
+        nCalls += 2;
+        glUseProgram(tessProgram);
+        glPatchParameteri(GL_PATCH_VERTICES, 3);
+        shaderProgram = tessProgram;
+        tessActive = true;
+    }
+    flushFrame();
+    ++nCalls;
+    if(nInstances == 0) glDrawElements(GL_PATCHES, n, indexType, (void*)(offset * indexSize));
+    else{
+        if(instBase != 0) instPointers(0);
+        glDrawElementsInstanced(GL_PATCHES, n, indexType, (void*)(offset * indexSize), nInstances);
+    }
+}
+
+// a vertex array with no buffers for drawProcedural(), only the instances
+// are read from a buffer, in place of createBuff()
+void oglWrap::createProcedural()
+{
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    vboLayout = vertLayout::procedural;
+    vboBytes = 0;
+}
+
+// 8 * 4^order triangles with no vertices or indices, vertex.shader makes each
+// vertex from gl_VertexID, without instances when nInstances is 0
+void oglWrap::drawProcedural(GLuint order, GLuint nInstances)
+{
+    if(order > 12) throw std::runtime_error("Error: oglWrap::drawProcedural(), order must not be greater than 12");
+    setInt(uniOrder, order);
+    matchLayout();
+    flushFrame();
+    ++nCalls;
+    const GLsizei n = GLsizei(24) << 2 * order;
+    if(nInstances == 0) glDrawArrays(GL_TRIANGLES, 0, n);
+    else{
+        if(instBase != 0) instPointers(0);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, n, nInstances);
+    }
+}
+
+// every vertex the procedural shader makes for the order, three per
+// triangle, caught with transform feedback and nothing rasterised. The
+// program is linked for the capture and not kept
+std::vector<GLfloat> oglWrap::captureProcedural(GLuint order)
+{
+    std::string vertexCode, fragmentCode;
+    shaderSources(vertexCode, fragmentCode);
+    GLuint vertexShader = compile(GL_VERTEX_SHADER, variant(vertexCode, vertLayout::procedural));
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    const char *varying = "UnitPos";
+    glTransformFeedbackVaryings(program, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success){
+        char infoLog[1024];
+        glGetProgramInfoLog(program, 1024, NULL, infoLog);
+        glDeleteProgram(program);
+        throw std::runtime_error("Error: oglWrap::captureProcedural(), link failed\n" + std::string(infoLog));
+    }
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "frame"), 0);
+    setInt(uniOrder, order);
+    flushFrame();
+
+    const GLsizei n = GLsizei(24) << 2 * order;
+    std::vector<GLfloat> out(3 * std::size_t(n));
+    GLuint empty, tfb;
+    glGenVertexArrays(1, &empty);
+    glBindVertexArray(empty);
+    glGenBuffers(1, &tfb);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, tfb);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, out.size() * sizeof(GLfloat), nullptr, GL_STATIC_READ);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tfb);
+    glUseProgram(program);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_TRIANGLES);
+    glDrawArrays(GL_TRIANGLES, 0, n);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, out.size() * sizeof(GLfloat), out.data());
+    glDeleteBuffers(1, &tfb);
+    glDeleteVertexArrays(1, &empty);
+    glDeleteProgram(program);
+    glUseProgram(shaderProgram);
+    glBindVertexArray(vao);
+    return out;
+}
+
+// GL 3.3 has no persistent mapping, so the new buffers are given fresh
+// storage and written through unsynchronised maps, which is safe as nothing
+// draws from them until swapBuff(). Staging again drops any unfinished set
+void oglWrap::stageBuff(bufView<GLfloat> vertices, indView indices, vertLayout layout)
+{
+    deleteStaged();
+    back.verts = vertices.data();
+    back.inds = static_cast<const unsigned char*>(indices.data());
+    back.vertBytes = vertices.size() / vertFormat::floats(layout) * vertFormat::stride(layout);
+    back.indBytes = indices.bytes();
+    back.layout = layout;
+    back.indexType = indices.type();
+    back.indexSize = indices.elemSize();
+    glGenVertexArrays(1, &back.vao);
+    glBindVertexArray(back.vao);
+    glGenBuffers(1, &back.vbo);
+    glGenBuffers(1, &back.ebo);
+    glBindBuffer(GL_ARRAY_BUFFER, back.vbo);
+    glBufferData(GL_ARRAY_BUFFER, back.vertBytes, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, back.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, back.indBytes, nullptr, GL_STATIC_DRAW);
+    vertexPointers(layout);
+    if(instancing){
+        instPointers(instBase);
+        instAttribs();
+    }
+    glBindVertexArray(vao); // draws carry on from the current buffers
+}
+
+// copies up to maxBytes more of the staged data, encoding whole vertices,
+// the element buffer is written through the copy target so no vertex
+// array's binding changes
+bool oglWrap::stageStep(std::size_t maxBytes)
+{
+    if(!back.vao) throw std::runtime_error("Error: oglWrap::stageStep(), nothing staged");
+    const std::size_t stride = vertFormat::stride(back.layout), nf = vertFormat::floats(back.layout);
+    while(maxBytes > 0 && back.done < back.vertBytes + back.indBytes){
+        const bool verts = back.done < back.vertBytes;
+        const GLuint buff = verts ? back.vbo : back.ebo;
+        const std::size_t offset = verts ? back.done : back.done - back.vertBytes;
+        std::size_t len = std::min(maxBytes, (verts ? back.vertBytes : back.indBytes) - offset);
+        if(verts) len = std::max(len / stride, std::size_t(1)) * stride;
+        nCalls += 3;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buff);
+        void *p = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, len,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if(!p) throw std::runtime_error("Error: oglWrap::stageStep(), glMapBufferRange() failed");
+        if(verts) vertFormat::encode(back.layout, back.verts + offset / stride * nf, len / stride, p);
+        else std::memcpy(p, back.inds + offset, len);
+        if(!glUnmapBuffer(GL_COPY_WRITE_BUFFER))
+            throw std::runtime_error("Error: oglWrap::stageStep(), buffer contents lost while mapped");
+        back.done += len;
+        maxBytes -= std::min(maxBytes, len);
+    }
+    return back.done == back.vertBytes + back.indBytes;
+}
+
+// the staged buffers replace the current ones, GL frees the old ones once
+// the draws already queued from them are done, so nothing waits
+void oglWrap::swapBuff()
+{
+    if(!back.vao || back.done != back.vertBytes + back.indBytes)
+        throw std::runtime_error("Error: oglWrap::swapBuff(), staging not finished");
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteVertexArrays(1, &vao);
+    vao = back.vao;
+    vbo = back.vbo;
+    ebo = back.ebo;
+    vboBytes = back.vertBytes;
+    vboLayout = back.layout;
+    indexType = back.indexType;
+    indexSize = back.indexSize;
+    back = staged();
+    ++nCalls;
+    glBindVertexArray(vao);
+}
+
+// Wrapper functions to set the uniforms, members of the frame block are
+// only copied, uniforms the shaders do not use are ignored
+oglWrap::uniformId oglWrap::uniform(const std::string &name)
+{
+    auto it = uniformIds.find(name);
+    return it == uniformIds.end() ? -1 : it -> second;
+}
+
+static void setBlock(const uniformInfo &u, const void *data, std::size_t bytes)
+{
+    std::memcpy(frameData.data() + u.offset, data, bytes);
+    frameDirty = true;
+}
+
+void oglWrap::setFloat(uniformId id, GLfloat value)
+{
+    if(id < 0) return;
+    const uniformInfo &u = uniforms[id];
+    if(u.offset >= 0) return setBlock(u, &value, sizeof(value));
+    ++nCalls;
+    glUniform1f(u.location, value); 
 }
 
+void oglWrap::setInt(uniformId id, GLint value)
+{
+    if(id < 0) return;
+    const uniformInfo &u = uniforms[id];
+    if(u.offset >= 0) return setBlock(u, &value, sizeof(value));
+    ++nCalls;
+    glUniform1i(u.location, value);
+}
+
+void oglWrap::setVec3(uniformId id, const GLfloat data[]) 
+{ 
+    if(id < 0) return;
+    const uniformInfo &u = uniforms[id];
+    if(u.offset >= 0) return setBlock(u, data, 3 * sizeof(GLfloat));
+    ++nCalls;
+    glUniform3fv(u.location, 1, data);
+}
 
+void oglWrap::setMat4(uniformId id, const GLfloat data[])
+{
+    if(id < 0) return;
+    const uniformInfo &u = uniforms[id];
+    if(u.offset >= 0) return setBlock(u, data, 16 * sizeof(GLfloat)); // the block is row major
+    ++nCalls;
+    glUniformMatrix4fv(u.location, 1, GL_TRUE, data); // transpose is set to true
+}
 
+void oglWrap::setColor(GLfloat x, GLfloat y, GLfloat z) 
+{  
+    const GLfloat rgb[] = {x, y, z};
+    setVec3(uniColor, rgb);
+}
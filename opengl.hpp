@@ -2,20 +2,57 @@
 // Stephen R Williams, Feb 2019
 // License: GPL-3.0
 
+#define openglDec
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
 namespace oglWrap
 {
+    // per sphere attributes for instanced drawing, laid out as the shader reads them
+    struct instance
+    {
+        GLfloat pos[3]; // translation
+        GLfloat scale;
+        GLfloat color[3]; // multiplies triangleColor
+    };
+    
     void info();
-    void createBuff(std::vector<GLfloat> &vertices, std::vector<GLuint> &indices);
+    void createBuff(bufView<GLfloat> vertices, indView indices, vertLayout layout);
+    GLuint64 growBuff(bufView<GLfloat> vertices, std::size_t keep, indView indices);
+    void deleteBuff();
+    // a second set of buffers is filled a slice at a time while the first
+    // is drawn, then swapped in between frames, the data must outlive it
+    void stageBuff(bufView<GLfloat> vertices, indView indices, vertLayout layout);
+    bool stageStep(std::size_t maxBytes); // true once everything is on the GPU
+    void swapBuff();
     void setUp();
     void close();
+    void clear(GLfloat r, GLfloat g, GLfloat b);
     void draw(GLuint n, GLuint offset);
+    void setInstances(bufView<instance> instances); // empty turns instancing off
+    void setInstance(const instance &inst); // for draw() while instancing is off
+    void drawInstanced(GLuint n, GLuint offset, GLuint nInstances, GLuint first = 0);
+    // spheres made in the shader from gl_VertexID, with no vertex buffers
+    void createProcedural();
+    void drawProcedural(GLuint order, GLuint nInstances = 0);
+    std::vector<GLfloat> captureProcedural(GLuint order); // xyz of every triangle's corners
+    // the buffer's triangles as patches divided on the GPU, needs OpenGL 4.0
+    void drawPatches(GLuint n, GLuint offset, GLuint nInstances = 0);
     
     std::vector<GLfloat>& perspective(GLfloat theta, GLfloat ar, GLfloat zn, GLfloat zf);
     std::vector<GLfloat>& rotateZ(GLfloat theta);
     std::vector<GLfloat>& rotateY(GLfloat theta);
     
-    void setFloat(const std::string &name, GLfloat value);
-    void setVec3(const std::string &name, GLfloat data[]);
-    void setMat4(const std::string &name, GLfloat data[]);
+    // a uniform looked up by name once, after setUp() and until close(), so
+    // setting it each frame is only a copy, -1 for one the shaders do not use
+    typedef GLint uniformId;
+    uniformId uniform(const std::string &name);
+    void setFloat(uniformId u, GLfloat value);
+    void setInt(uniformId u, GLint value);
+    void setVec3(uniformId u, const GLfloat data[]);
+    void setMat4(uniformId u, const GLfloat data[]);
     void setColor(GLfloat x, GLfloat y, GLfloat z); 
+    GLuint64 glCalls(bool reset = true);
 }
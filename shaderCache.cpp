@@ -0,0 +1,116 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <cstring>
+#include <cstdint>
+#include "meshCache.hpp"
+#include "shaderCache.hpp"
+
+static const char magic[8] = {'S', 'P', 'H', 'P', 'R', 'O', 'G', '\0'};
+
+struct header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t format; // GLenum from glGetProgramBinary()
+    std::uint64_t key; // sources and driver
+    std::uint64_t length; // of the binary which follows
+    std::uint64_t checksum; // of the binary
+};
+
+static std::string glString(GLenum name)
+{
+    const GLubyte *s = glGetString(name);
+    return s ? reinterpret_cast<const char*>(s) : "";
+}
+
+static std::uint64_t key(const std::string &vertexCode, const std::string &fragmentCode)
+{
+    std::uint64_t h = meshCache::hash(&shaderCache::version, sizeof(shaderCache::version));
+    for(const std::string &s: {vertexCode, fragmentCode, glString(GL_VENDOR), glString(GL_RENDERER), glString(GL_VERSION)}){
+        const std::uint64_t len = s.size(); // so the boundaries between strings count
+        h = meshCache::hash(&len, sizeof(len), h);
+        h = meshCache::hash(s.data(), s.size(), h);
+    }
+    return h;
+}
+
+static std::string fileName(std::uint64_t k)
+{
+    std::ostringstream oss;
+    oss << "program-v" << shaderCache::version << '-' << std::hex << std::setw(16) << std::setfill('0') << k << ".bin";
+    return oss.str();
+}
+
+bool shaderCache::available()
+{
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+    return n > 0;
+}
+
+GLuint shaderCache::load(const std::string &vertexCode, const std::string &fragmentCode)
+{
+    if(!available()) return 0;
+    const std::uint64_t k = key(vertexCode, fragmentCode);
+    const std::string name = meshCache::dir() + '/' + fileName(k);
+    std::ifstream fin(name, std::ios::binary);
+    if(!fin) return 0;
+    std::vector<char> file((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    
+    header hd;
+    bool ok = file.size() >= sizeof(hd);
+    if(ok){
+        std::memcpy(&hd, file.data(), sizeof(hd));
+        ok = std::memcmp(hd.magic, magic, sizeof(magic)) == 0 && hd.version == version && hd.key == k
+            && hd.length == file.size() - sizeof(hd)
+            && meshCache::hash(file.data() + sizeof(hd), hd.length) == hd.checksum;
+    }
+    GLuint program = 0;
+    if(ok){
+        // a driver update can still reject a binary, that shows as a failed link
+        program = glCreateProgram();
+        glProgramBinary(program, hd.format, file.data() + sizeof(hd), hd.length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if(!linked){
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if(!program) std::cerr << "shaderCache: ignoring invalid cache file " << name << std::endl;
+    return program;
+}
+
+void shaderCache::store(GLuint program, const std::string &vertexCode, const std::string &fragmentCode)
+{
+    if(!available()) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return;
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    
+    header hd = {};
+    std::memcpy(hd.magic, magic, sizeof(magic));
+    hd.version = version;
+    hd.format = format;
+    hd.key = key(vertexCode, fragmentCode);
+    hd.length = length;
+    hd.checksum = meshCache::hash(binary.data(), length);
+    const std::vector<bufView<char>> parts = {{reinterpret_cast<const char*>(&hd), sizeof(hd)}, {binary.data(), hd.length}};
+    if(!meshCache::writeFile(fileName(hd.key), parts))
+        std::cerr << "shaderCache: warning, cannot write to " << meshCache::dir() << ", program not cached" << std::endl;
+}
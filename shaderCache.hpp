@@ -0,0 +1,23 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef shaderCacheDec
+#define shaderCacheDec
+
+// On disk cache of linked shader programs, kept beside the mesh cache in
+// meshCache::dir(). A program binary is only good for the driver that made
+// it, so files are keyed by a hash of the shader sources and the GL vendor,
+// renderer and version strings, and any file GL refuses counts as a miss.
+namespace shaderCache
+{
+    const GLuint version = 1;
+    
+    bool available(); // the driver offers at least one binary format
+    // the linked program, or 0 on a miss, needs a current context
+    GLuint load(const std::string &vertexCode, const std::string &fragmentCode);
+    // link the program with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    void store(GLuint program, const std::string &vertexCode, const std::string &fragmentCode);
+}
+
+#endif
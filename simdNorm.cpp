@@ -0,0 +1,142 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_NORM_X86
+#endif
+#include "simdNorm.hpp"
+
+static void normScalar(GLfloat *v, std::size_t n)
+{
+    GLfloat x, y, z, r;
+    
+    for(std::size_t i=0; i<n; ++i, v+=3){
+        x = v[0];
+        y = v[1];
+        z = v[2];
+        r = sqrt(x * x + y * y + z * z);
+        v[0] = x / r;
+        v[1] = y / r;
+        v[2] = z / r;
+    }
+}
+
+#ifdef SIMD_NORM_X86
+// 4 vertices, 12 floats, per step
+static void normSSE4(GLfloat *v)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 x = _mm_set_ps(v[9], v[6], v[3], v[0]);
+    __m128 y = _mm_set_ps(v[10], v[7], v[4], v[1]);
+    __m128 z = _mm_set_ps(v[11], v[8], v[5], v[2]);
+    __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    __m128 s = _mm_rsqrt_ps(r2);
+    // one Newton step written as a correction, s += s * (0.5 - 0.5 * r2 * s * s)
+    s = _mm_add_ps(s, _mm_mul_ps(s, _mm_sub_ps(half, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(half, r2), s), s))));
+    // spread s0..s3 to line up with x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+    __m128 s0 = _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 0, 0));
+    __m128 s1 = _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 1, 1));
+    __m128 s2 = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 2));
+    _mm_storeu_ps(v, _mm_mul_ps(_mm_loadu_ps(v), s0));
+    _mm_storeu_ps(v + 4, _mm_mul_ps(_mm_loadu_ps(v + 4), s1));
+    _mm_storeu_ps(v + 8, _mm_mul_ps(_mm_loadu_ps(v + 8), s2));
+}
+
+// 8 vertices, 24 floats, per step
+__attribute__((target("avx2")))
+static void normAVX2_8(GLfloat *v)
+{
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    __m256 x = _mm256_i32gather_ps(v, stride, 4);
+    __m256 y = _mm256_i32gather_ps(v + 1, stride, 4);
+    __m256 z = _mm256_i32gather_ps(v + 2, stride, 4);
+    __m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+    __m256 s = _mm256_rsqrt_ps(r2);
+    s = _mm256_add_ps(s, _mm256_mul_ps(s, _mm256_sub_ps(half, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(half, r2), s), s))));
+    // spread s0..s7 over the three interleaved blocks of eight floats
+    __m256 s0 = _mm256_permutevar8x32_ps(s, _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2));
+    __m256 s1 = _mm256_permutevar8x32_ps(s, _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5));
+    __m256 s2 = _mm256_permutevar8x32_ps(s, _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7));
+    _mm256_storeu_ps(v, _mm256_mul_ps(_mm256_loadu_ps(v), s0));
+    _mm256_storeu_ps(v + 8, _mm256_mul_ps(_mm256_loadu_ps(v + 8), s1));
+    _mm256_storeu_ps(v + 16, _mm256_mul_ps(_mm256_loadu_ps(v + 16), s2));
+}
+#endif
+
+// runs a block kernel over n vertices, the ragged end is padded out to a
+// whole block so it gets exactly the same arithmetic as the rest
+template<std::size_t B, void (*block)(GLfloat*)>
+static void normBlocks(GLfloat *v, std::size_t n)
+{
+    std::size_t i;
+    
+    for(i=0; i+B<=n; i+=B) block(v + 3 * i);
+    if(i == n) return;
+    GLfloat pad[3 * B];
+    std::fill(pad, pad + 3 * B, 1.0f);
+    std::copy(v + 3 * i, v + 3 * n, pad);
+    block(pad);
+    std::copy(pad, pad + 3 * (n - i), v + 3 * i);
+}
+
+static simdNorm::kernel chosen = simdNorm::kernel::scalar;
+
+// checks the cpu can run kernel k and returns it
+static void (*pick(simdNorm::kernel k))(GLfloat*, std::size_t)
+{
+#ifdef SIMD_NORM_X86
+    __builtin_cpu_init();
+    const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if(k == simdNorm::kernel::automatic) k = hasAVX2 ? simdNorm::kernel::avx2 : simdNorm::kernel::sse;
+    if(k == simdNorm::kernel::avx2 && !hasAVX2)
+        throw std::runtime_error("Error: simdNorm::force(), this cpu does not support AVX2");
+#else
+    if(k == simdNorm::kernel::automatic) k = simdNorm::kernel::scalar;
+    if(k != simdNorm::kernel::scalar)
+        throw std::runtime_error("Error: simdNorm::force(), only the scalar kernel is built for this cpu");
+#endif
+    chosen = k;
+    switch(k){
+#ifdef SIMD_NORM_X86
+        case simdNorm::kernel::avx2: return normBlocks<8, normAVX2_8>;
+        case simdNorm::kernel::sse: return normBlocks<4, normSSE4>;
+#endif
+        default: return normScalar;
+    }
+}
+
+// picked once at start up, so worker threads only ever read it
+static void (*normFn)(GLfloat*, std::size_t) = pick(simdNorm::kernel::automatic);
+
+void simdNorm::force(kernel k)
+{
+    normFn = pick(k);
+}
+
+void simdNorm::normalize(GLfloat *v, std::size_t n)
+{
+    normFn(v, n);
+}
+
+simdNorm::kernel simdNorm::current()
+{
+    return chosen;
+}
+
+const char* simdNorm::name()
+{
+    switch(chosen){
+        case kernel::avx2: return "avx2";
+        case kernel::sse: return "sse";
+        default: return "scalar";
+    }
+}
@@ -0,0 +1,27 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef simdNormDec
+#define simdNormDec
+
+// Scales batches of xyz triples to unit length, in place.
+// The scalar kernel is exact, sqrt then divide. The SSE and AVX2 kernels use
+// rsqrt plus one Newton step and stay within maxUlpPerNormalize of the scalar
+// kernel given the same input. That bounds one call only. Vertices are built
+// from earlier ones, so a whole mesh drifts by about order - 1 ulp, 7 at
+// order 8 and 9 at order 10, and no bound is promised for it.
+// Every vertex goes through the same arithmetic whatever the batch boundaries,
+// so results never depend on how the work was split between threads.
+namespace simdNorm
+{
+    enum class kernel { automatic, scalar, sse, avx2 };
+    const GLuint maxUlpPerNormalize = 4; // one normalize() against the scalar kernel
+    
+    void normalize(GLfloat *v, std::size_t n); // n triples starting at v
+    void force(kernel k); // automatic picks the best the cpu supports
+    kernel current();
+    const char* name();
+}
+
+#endif
@@ -6,75 +6,303 @@
 #include <GL/glew.h>
 #include <vector>
 #include <array>
-#include <stack>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <sys/resource.h>
 #define is_sphere_cpp
 #include "sphere.hpp"
 #include "sphereObj.hpp"
+#include "meshCache.hpp"
+#include "sphereTables.hpp"
+#include "vcache.hpp"
 
 // API interface for an openGL sphere builder
 // Stephen R Williams, Jan 2019
 
-static const GLuint maxn = 6;
 static std::unique_ptr<sphereObj> mySphere;
+static std::unique_ptr<meshCache::mapped> myMap, myMapNorms; // cached instead of built
 static std::vector<GLfloat> vec2;
+static std::vector<GLushort> vecInds16;
+// the current mesh, whether it was built, mapped or baked in
+static bufView<GLfloat> myVerts;
+static bufView<GLuint> myInds;
+static bufView<GLushort> myInds16;
+static bool haveMesh = false;
+static GLuint myOrder;
+static GLuint nThreads = 1;
+static bool keepTopology = true;
+static bool useCache = false;
+static bool useBaked = true;
+static bool vcOrder = false;
+static indType myIndType = indType::automatic;
+static bool packLevels = false;
+static std::vector<sphere::level> myLevels;
 
-// build vertex and triangle vectors for order n sphere
+// the geometric error of each packed level, the distance from the unit
+// sphere to the furthest inside point of any triangle, which is where the
+// triangle's plane is closest to the centre
+static void measureLevels()
+{
+    myLevels.clear();
+    for(GLuint l=0; l<=myOrder; ++l){
+        const GLuint64 offset = sphereObj::levelOffset(l), count = sphereObj::levelOffset(l + 1) - offset;
+        GLfloat err = 0.0f;
+        for(GLuint64 i=offset; i<offset+count; i+=3){
+            const GLfloat *a = &myVerts[3 * std::size_t(myInds[i])];
+            const GLfloat *b = &myVerts[3 * std::size_t(myInds[i + 1])];
+            const GLfloat *c = &myVerts[3 * std::size_t(myInds[i + 2])];
+            const GLfloat u[] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            const GLfloat v[] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            const GLfloat n[] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+            const GLfloat len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            err = std::max(err, 1.0f - std::abs(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]) / len);
+        }
+        myLevels.push_back({offset, count, err});
+    }
+}
+
+// build vertex and triangle vectors for order n sphere, a sphere built
+// before with its topology kept is refined when n is at least its order,
+// its vertices keep their numbers so GetVerts() only grows at the end
 void sphere::build(GLuint order)
 {   
-    if(order > maxn){
+    if(order > sphere::maxn){
         std::ostringstream oss;
-        oss << "Error: sphere::build(" << order << "), n must not be greater than " << maxn;
+        oss << "Error: sphere::build(" << order << "), n must not be greater than " << sphere::maxn;
         std::string str =  oss.str();
         throw std::runtime_error(str);
     }
-    if(mySphere){
-        mySphere.reset();
+    // a built sphere of a lower order, with its topology, carries on from
+    // where it is rather than starting over, unless the order is baked in.
+    // A level packed sphere never does, whatever setLevels() says now
+    std::unique_ptr<sphereObj> grow;
+    if(mySphere && mySphere -> hasTopology() && !mySphere -> isLevelPacked() && !packLevels && !vcOrder
+        && order >= mySphere -> GetOrder()
+        && !(useBaked && order <= sphereTables::maxOrder)) grow = std::move(mySphere);
+    release();
+    myOrder = order;
+    haveMesh = true;
+    if(grow){
+        mySphere = std::move(grow);
+        const bool same = order == mySphere -> GetOrder(); // nothing to refine, nor to cache again
+        if(!same){
+            mySphere -> refine(order);
+            std::cout << "sphere: order " << order << " refined, peak RSS = " << (peakRSS() >> 10) << " MB" << std::endl;
+        }
+        // only once refined, which needs the topology
+        if(!keepTopology) mySphere -> dropTopology();
+        myVerts = mySphere -> GetVerts();
+        myInds = mySphere -> GetInds();
+        if(useCache && !same) meshCache::store(order, vertLayout::pos, vcOrder, myVerts, myInds);
+        return;
+    }
+    if(packLevels){
+        // neither baked nor cached, both hold a single order
+        mySphere = std::make_unique<sphereObj>(order, nThreads, true);
+        if(!keepTopology) mySphere -> dropTopology();
+        if(vcOrder) mySphere -> optimize(vcache::defaultCache);
+        std::cout << "sphere: orders 0 to " << order << " built, peak RSS = " << (peakRSS() >> 10) << " MB" << std::endl;
+        myVerts = mySphere -> GetVerts();
+        myInds = mySphere -> GetInds();
+        measureLevels();
+        return;
+    }
+    if(useBaked && !vcOrder && order <= sphereTables::maxOrder){
+        myVerts = sphereTables::GetVerts(order);
+        myInds = sphereTables::GetInds(order);
+        myInds16 = sphereTables::GetInds16(order);
+        return;
+    }
+    if(useCache){
+        myMap = meshCache::load(order, vertLayout::pos, vcOrder);
+        if(myMap){
+            std::cout << "sphere: order " << order << " mapped from " << meshCache::dir() << std::endl;
+            myVerts = myMap -> GetVerts();
+            myInds = myMap -> GetInds();
+            return;
+        }
     }
-    mySphere = std::make_unique<sphereObj>(order);
+    mySphere = std::make_unique<sphereObj>(order, nThreads);
+    if(!keepTopology) mySphere -> dropTopology();
+    if(vcOrder) mySphere -> optimize(vcache::defaultCache);
     //mySphere -> setVects(mySphere);
+    std::cout << "sphere: order " << order << " built, peak RSS = " << (peakRSS() >> 10) << " MB" << std::endl;
+    myVerts = mySphere -> GetVerts();
+    myInds = mySphere -> GetInds();
+    if(useCache) meshCache::store(order, vertLayout::pos, vcOrder, myVerts, myInds);
+}
+
+// builds on a thread of its own, with the settings as they are now, and
+// copies the result out so the caller owns it and this namespace is left
+// released. A built sphere with its topology is kept back, so the next
+// higher order asked for is refined from it. The mutex keeps a second request
+// from starting until the first is done, errors are thrown from the future's get()
+std::future<sphere::mesh> sphere::buildAsync(GLuint order)
+{
+    static std::mutex building;
+    return std::async(std::launch::async, [order]{
+        std::lock_guard<std::mutex> lock(building);
+        mesh m;
+        m.order = order;
+        build(order);
+        m.verts.assign(myVerts.begin(), myVerts.end());
+        const indView ib = GetIndBuff();
+        if(ib.type() == GL_UNSIGNED_SHORT) m.inds16.assign(myInds16.begin(), myInds16.end());
+        else m.inds.assign(myInds.begin(), myInds.end());
+        m.levels = myLevels;
+        std::unique_ptr<sphereObj> keep;
+        if(mySphere && mySphere -> hasTopology()) keep = std::move(mySphere);
+        release();
+        mySphere = std::move(keep);
+        return m;
+    });
+}
+
+// whether builds reorder the mesh for the post-transform vertex cache,
+// the reordered mesh has no triangle topology and is never baked
+void sphere::setOptimize(bool optimize)
+{
+    vcOrder = optimize;
+}
+
+// whether orders up to sphereTables::maxOrder are served from the tables
+// baked into the binary, these have no triangle topology
+void sphere::setBaked(bool use)
+{
+    useBaked = use;
+}
+
+// whether builds first look in, and then write to, the on disk mesh cache
+// a mesh mapped from the cache has no triangle topology
+void sphere::setCache(bool use)
+{
+    useCache = use;
+}
+
+// threads used by subsequent builds, 0 for one per hardware thread
+// the mesh is the same whatever the number of threads
+void sphere::setThreads(GLuint n)
+{
+    if(n == 0) n = std::thread::hardware_concurrency();
+    nThreads = n > 0 ? n : 1;
+}
+
+GLuint sphere::GetThreads()
+{
+    return nThreads;
 }
 
-const std::vector<GLfloat>& sphere::GetVerts()
+// whether builds keep the triangle neighbours once the index buffer
+// is done, a little over half the memory of the triangles
+void sphere::setKeepTopology(bool keep)
 {
-    if(!mySphere) throw std::runtime_error("Error: sphere::GetVerts() called before sphere::build()");
-    return mySphere -> GetVerts();
+    keepTopology = keep;
 }
 
-const std::vector<GLfloat>& sphere::GetVertsNorms()
+// whether builds pack every order from 0 to n into one index buffer, the
+// vertices of order n serve them all, see GetLevels() for where each starts
+void sphere::setLevels(bool pack)
 {
-    if(!mySphere) throw std::runtime_error("Error: sphere::GetVerts2() called before sphere::build()");
-    GLuint len = mySphere -> GetVerts().size();
-    vec2.reserve(2 * len);
+    packLevels = pack;
+}
+
+const std::vector<sphere::level>& sphere::GetLevels()
+{
+    if(!haveMesh || !packLevels) throw std::runtime_error("Error: sphere::GetLevels() called without a level packed build");
+    return myLevels;
+}
+
+// peak resident set size of the process so far, in kilobytes
+GLuint64 sphere::peakRSS()
+{
+    struct rusage usage;
     
-    GLuint i = 0;
-    std::array<GLfloat, 3> arry;
-    auto vec = mySphere -> GetVerts();
-    for(auto r: vec){
-        arry.at(i++) = r; 
-        if(i==3){
-            i = 0;
-            for(auto x: arry) vec2.push_back(x);
-            for(auto x: arry) vec2.push_back(x);
-        }   
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_maxrss;
+}
+
+bufView<GLfloat> sphere::GetVerts()
+{
+    if(!haveMesh) throw std::runtime_error("Error: sphere::GetVerts() called before sphere::build()");
+    return myVerts;
+}
+
+// the interleaved buffer is made, or mapped from the cache, on the first
+// call after each build, later calls hand out the same buffer
+bufView<GLfloat> sphere::GetVertsNorms()
+{
+    if(!haveMesh) throw std::runtime_error("Error: sphere::GetVertsNorms() called before sphere::build()");
+    if(!vec2.empty()) return vec2;
+    if(myMapNorms) return myMapNorms -> GetVerts();
+    if(useCache){
+        myMapNorms = meshCache::load(myOrder, vertLayout::posNorm, vcOrder);
+        if(myMapNorms) return myMapNorms -> GetVerts();
     }
-    if(i != 0) throw std::runtime_error("Error: sphere::GetVerts2(), vector length not a multiple of 3");
+    const auto vec = myVerts;
+    if(vec.size() % 3 != 0) throw std::runtime_error("Error: sphere::GetVertsNorms(), vector length not a multiple of 3");
+    vec2.resize(2 * vec.size());
+    
+    GLfloat *out = vec2.data();
+    for(std::size_t i=0; i<vec.size(); i+=3, out+=6){
+        // on a unit sphere the normal is the position
+        out[0] = out[3] = vec[i];
+        out[1] = out[4] = vec[i + 1];
+        out[2] = out[5] = vec[i + 2];
+    }
+    if(useCache) meshCache::store(myOrder, vertLayout::posNorm, vcOrder, vec2, myInds);
     return vec2;
 }
 
-const std::vector<GLuint>& sphere::GetInds()
+bufView<GLuint> sphere::GetInds()
+{
+    if(!haveMesh) throw std::runtime_error("Error: sphere::GetInds() called before sphere::build()");
+    return myInds;
+}
+
+// 16 bit copy of the index buffer, made on the first call after each build
+bufView<GLushort> sphere::GetInds16()
+{
+    if(!haveMesh) throw std::runtime_error("Error: sphere::GetInds16() called before sphere::build()");
+    if(!myInds16.empty()) return myInds16;
+    if(myVerts.size() / 3 > 65536){
+        std::ostringstream oss;
+        oss << "Error: sphere::GetInds16(), " << myVerts.size() / 3 << " vertices do not fit 16 bit indices";
+        throw std::runtime_error(oss.str());
+    }
+    vecInds16.assign(myInds.begin(), myInds.end());
+    myInds16 = vecInds16;
+    return myInds16;
+}
+
+// the index buffer in the width set by setIndexType()
+indView sphere::GetIndBuff()
+{
+    if(!haveMesh) throw std::runtime_error("Error: sphere::GetIndBuff() called before sphere::build()");
+    bool use16 = myIndType == indType::u16;
+    if(myIndType == indType::automatic) use16 = myVerts.size() / 3 <= 65536;
+    if(use16) return GetInds16();
+    return GetInds();
+}
+
+// automatic uses 16 bit indices up to order 6, which halves the index buffer
+void sphere::setIndexType(indType type)
 {
-    if(!mySphere) throw std::runtime_error("Error: sphere::GetInds() called before sphere::build()");
-    return mySphere -> GetInds();
+    myIndType = type;
 }
 
-GLuint sphere::GetNInds()
+GLuint64 sphere::GetNInds()
 {
-    if(!mySphere) throw std::runtime_error("Error: sphere::GetNInds() called before sphere::build()");
-    return mySphere -> GetNInds();
+    if(!haveMesh) throw std::runtime_error("Error: sphere::GetNInds() called before sphere::build()");
+    return myInds.size();
 }
 
 
@@ -82,6 +310,15 @@ GLuint sphere::GetNInds()
 void sphere::release()
 {
     if(mySphere) mySphere.reset();
+    myMap.reset();
+    myMapNorms.reset();
+    std::vector<GLfloat>().swap(vec2);
+    std::vector<GLushort>().swap(vecInds16);
+    myVerts = bufView<GLfloat>();
+    myInds = bufView<GLuint>();
+    myInds16 = bufView<GLushort>();
+    myLevels.clear();
+    haveMesh = false;
 }
 
 
@@ -4,15 +4,51 @@
 
 #define sphereDec
 
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
 namespace sphere
 {
+    // one order of a level packed build, offset and count are in indices,
+    // err is the furthest the flat triangles fall inside the unit sphere
+    struct level { GLuint64 offset, count; GLfloat err; };
+
+    // a mesh which owns its buffers, as buildAsync() hands it over
+    struct mesh
+    {
+        GLuint order = 0;
+        std::vector<GLfloat> verts; // xyz per vertex
+        std::vector<GLuint> inds; // only one of inds and inds16 is filled,
+        std::vector<GLushort> inds16; // in the width set by setIndexType()
+        std::vector<level> levels;
+        indView GetIndBuff() const { return inds16.empty() ? indView(bufView<GLuint>(inds)) : indView(bufView<GLushort>(inds16)); }
+        GLuint64 GetNInds() const { return inds16.empty() ? inds.size() : inds16.size(); }
+    };
+
+    // order 15 has 4^16 + 2 vertices, too many to index with a GLuint
+    const GLuint maxn = 14;
+
     // public functions, to be called from outside
-    const std::vector<GLfloat>& GetVerts();
-    const std::vector<GLfloat>& GetVertsNorms();
-    const std::vector<GLuint>& GetInds();
+    bufView<GLfloat> GetVerts(); // xyz per vertex
+    bufView<GLfloat> GetVertsNorms(); // xyz then normal per vertex
+    bufView<GLuint> GetInds();
+    bufView<GLushort> GetInds16();
+    indView GetIndBuff(); // in the width set by setIndexType()
     void build(GLuint);
+    std::future<mesh> buildAsync(GLuint order); // no other calls until it is ready
+    void setThreads(GLuint);
+    GLuint GetThreads(); // as resolved by setThreads(), never 0
+    void setKeepTopology(bool);
+    void setCache(bool);
+    void setBaked(bool);
+    void setOptimize(bool);
+    void setIndexType(indType);
+    void setLevels(bool); // builds pack every order from 0 up
+    const std::vector<level>& GetLevels();
     void release();
-    GLuint GetNInds();
+    GLuint64 GetNInds();
+    GLuint64 peakRSS();
 }
 
 
@@ -0,0 +1,336 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPHERE_INDEX_X86
+#endif
+#include "sphereIndex.hpp"
+
+namespace
+{
+    struct vec
+    {
+        GLfloat x, y, z;
+    };
+}
+
+// the equator's corners of the octahedron, +x +y -x -y, which are vertices
+// 2 to 5 of sphereObj::octahedron(), face q and q + 4 run from corner q to q + 1
+static const vec square[4] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
+static const std::size_t batch = 4096; // queries worked on together
+static const int maxSteps = 16; // planes tried by a ray before it is a miss
+static const GLfloat edgeTol = 1e-6f; // barycentric slack, so a ray along an edge is not lost between two triangles
+
+// the sum of two corners scaled to unit length, the middle of their edge
+static vec mid(const vec &a, const vec &b)
+{
+    const GLfloat x = a.x + b.x, y = a.y + b.y, z = a.z + b.z;
+    const GLfloat r = std::sqrt(x * x + y * y + z * z);
+    return {x / r, y / r, z / r};
+}
+
+// p dotted with u cross v, which side of the plane through u, v and the centre p is on
+static GLfloat side(const vec &p, const vec &u, const vec &v)
+{
+    return p.x * (u.y * v.z - u.z * v.y) + p.y * (u.z * v.x - u.x * v.z) + p.z * (u.x * v.y - u.y * v.x);
+}
+
+// the builder's number of the triangle p is in. s is the sign of the winding
+// of a, b, c seen from outside, the corner children keep it and the middle
+// child, c a then b c then a b, turns it over
+static GLuint descend(const vec &p, GLuint order)
+{
+    const bool below = p.z < 0.0f;
+    const int q = p.x >= 0.0f ? (p.y >= 0.0f ? 0 : 3) : (p.y >= 0.0f ? 1 : 2);
+    vec a = square[q], b = square[(q + 1) & 3], c = {0.0f, 0.0f, below ? -1.0f : 1.0f};
+    GLfloat s = c.z;
+    GLuint id = q + (below ? 4 : 0), base = 8;
+    for(GLuint l=0; l<order; ++l, base*=4){
+        const vec ab = mid(a, b), bc = mid(b, c), ca = mid(c, a);
+        if(s * side(p, ab, ca) > 0.0f){
+            b = ab;
+            c = ca;
+            id = base + 3 * id;
+        }
+        else if(s * side(p, bc, ab) > 0.0f){
+            a = ab;
+            c = bc;
+            id = base + 3 * id + 1;
+        }
+        else if(s * side(p, ca, bc) > 0.0f){
+            a = ca;
+            b = bc;
+            id = base + 3 * id + 2;
+        }
+        else{
+            a = ca;
+            b = bc;
+            c = ab;
+            s = -s;
+        }
+    }
+    return id;
+}
+
+static void descendScalar(const GLfloat *dirs, std::size_t n, GLuint order, GLuint *ids)
+{
+    for(std::size_t i=0; i<n; ++i, dirs+=3) ids[i] = descend({dirs[0], dirs[1], dirs[2]}, order);
+}
+
+#ifdef SPHERE_INDEX_X86
+namespace
+{
+    struct vec8
+    {
+        __m256 x, y, z;
+    };
+}
+
+__attribute__((target("avx2")))
+static inline vec8 mid8(const vec8 &a, const vec8 &b)
+{
+    const __m256 x = _mm256_add_ps(a.x, b.x), y = _mm256_add_ps(a.y, b.y), z = _mm256_add_ps(a.z, b.z);
+    const __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+    return {_mm256_div_ps(x, r), _mm256_div_ps(y, r), _mm256_div_ps(z, r)};
+}
+
+__attribute__((target("avx2")))
+static inline __m256 side8(const vec8 &p, const vec8 &u, const vec8 &v)
+{
+    const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(u.y, v.z), _mm256_mul_ps(u.z, v.y));
+    const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(u.z, v.x), _mm256_mul_ps(u.x, v.z));
+    const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(u.x, v.y), _mm256_mul_ps(u.y, v.x));
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.x, cx), _mm256_mul_ps(p.y, cy)), _mm256_mul_ps(p.z, cz));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 pick8(__m256 no, __m256 yes, __m256 mask)
+{
+    return _mm256_blendv_ps(no, yes, mask);
+}
+
+// descend() for 8 directions at once, each lane goes through the same
+// arithmetic as the scalar code, so the two give the same triangles
+__attribute__((target("avx2")))
+static void descendAVX2_8(const GLfloat *dirs, GLuint order, GLuint *ids)
+{
+    const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21), one = _mm256_set1_epi32(1);
+    const __m256 zero = _mm256_setzero_ps(), signBit = _mm256_set1_ps(-0.0f);
+    const vec8 p = {_mm256_i32gather_ps(dirs, stride, 4), _mm256_i32gather_ps(dirs + 1, stride, 4),
+                    _mm256_i32gather_ps(dirs + 2, stride, 4)};
+    const __m256 below = _mm256_cmp_ps(p.z, zero, _CMP_LT_OQ);
+    const __m256i xNeg = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(p.x, zero, _CMP_LT_OQ)), one);
+    const __m256i yNeg = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(p.y, zero, _CMP_LT_OQ)), one);
+    const __m256i q = _mm256_xor_si256(xNeg, _mm256_mullo_epi32(yNeg, _mm256_set1_epi32(3))); // 0 1 2 3 round the equator
+    // the corners of the face from tables of the four quadrants
+    vec8 a = {_mm256_permutevar8x32_ps(_mm256_setr_ps(1, 0, -1, 0, 0, 0, 0, 0), q),
+              _mm256_permutevar8x32_ps(_mm256_setr_ps(0, 1, 0, -1, 0, 0, 0, 0), q), zero};
+    vec8 b = {_mm256_permutevar8x32_ps(_mm256_setr_ps(0, -1, 0, 1, 0, 0, 0, 0), q),
+              _mm256_permutevar8x32_ps(_mm256_setr_ps(1, 0, -1, 0, 0, 0, 0, 0), q), zero};
+    vec8 c = {zero, zero, pick8(_mm256_set1_ps(1.0f), _mm256_set1_ps(-1.0f), below)};
+    __m256 s = c.z;
+    __m256i id = _mm256_add_epi32(q, _mm256_and_si256(_mm256_castps_si256(below), _mm256_set1_epi32(4)));
+    GLuint base = 8;
+    for(GLuint l=0; l<order; ++l, base*=4){
+        const vec8 ab = mid8(a, b), bc = mid8(b, c), ca = mid8(c, a);
+        const __m256 inA = _mm256_cmp_ps(_mm256_mul_ps(s, side8(p, ab, ca)), zero, _CMP_GT_OQ);
+        const __m256 inB = _mm256_andnot_ps(inA, _mm256_cmp_ps(_mm256_mul_ps(s, side8(p, bc, ab)), zero, _CMP_GT_OQ));
+        const __m256 inC = _mm256_andnot_ps(_mm256_or_ps(inA, inB), _mm256_cmp_ps(_mm256_mul_ps(s, side8(p, ca, bc)), zero, _CMP_GT_OQ));
+        const __m256 inM = _mm256_andnot_ps(_mm256_or_ps(_mm256_or_ps(inA, inB), inC), _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+        const vec8 na = {pick8(pick8(ca.x, ab.x, inB), a.x, inA), pick8(pick8(ca.y, ab.y, inB), a.y, inA),
+                         pick8(pick8(ca.z, ab.z, inB), a.z, inA)};
+        const vec8 nb = {pick8(pick8(bc.x, b.x, inB), ab.x, inA), pick8(pick8(bc.y, b.y, inB), ab.y, inA),
+                         pick8(pick8(bc.z, b.z, inB), ab.z, inA)};
+        c = {pick8(pick8(pick8(ab.x, c.x, inC), bc.x, inB), ca.x, inA), pick8(pick8(pick8(ab.y, c.y, inC), bc.y, inB), ca.y, inA),
+             pick8(pick8(pick8(ab.z, c.z, inC), bc.z, inB), ca.z, inA)};
+        a = na;
+        b = nb;
+        s = _mm256_xor_ps(s, _mm256_and_ps(inM, signBit));
+        // base + 3 id + child for the corner children, the middle keeps its number
+        const __m256i child = _mm256_add_epi32(_mm256_and_si256(_mm256_castps_si256(inB), one),
+                                               _mm256_and_si256(_mm256_castps_si256(inC), _mm256_set1_epi32(2)));
+        const __m256i next = _mm256_add_epi32(_mm256_add_epi32(_mm256_set1_epi32(base), _mm256_add_epi32(id, _mm256_slli_epi32(id, 1))), child);
+        id = _mm256_blendv_epi8(next, id, _mm256_castps_si256(inM));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ids), id);
+}
+
+// whole blocks of 8, the ragged end is padded out so it gets the same arithmetic
+static void descendAVX2(const GLfloat *dirs, std::size_t n, GLuint order, GLuint *ids)
+{
+    std::size_t i;
+    for(i=0; i+8<=n; i+=8) descendAVX2_8(dirs + 3 * i, order, ids + i);
+    if(i == n) return;
+    GLfloat pad[24];
+    GLuint out[8];
+    std::fill(pad, pad + 24, 1.0f);
+    std::copy(dirs + 3 * i, dirs + 3 * n, pad);
+    descendAVX2_8(pad, order, out);
+    std::copy(out, out + (n - i), ids + i);
+}
+#endif
+
+// checks the cpu can run kernel k and returns it, automatic picks the best
+static sphereIndex::kernel resolve(sphereIndex::kernel k)
+{
+#ifdef SPHERE_INDEX_X86
+    __builtin_cpu_init();
+    const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if(k == sphereIndex::kernel::automatic) k = hasAVX2 ? sphereIndex::kernel::avx2 : sphereIndex::kernel::scalar;
+    if(k == sphereIndex::kernel::avx2 && !hasAVX2)
+        throw std::runtime_error("Error: sphereIndex, this cpu does not support AVX2");
+#else
+    if(k == sphereIndex::kernel::automatic) k = sphereIndex::kernel::scalar;
+    if(k != sphereIndex::kernel::scalar)
+        throw std::runtime_error("Error: sphereIndex, only the scalar kernel is built for this cpu");
+#endif
+    return k;
+}
+
+static void descendBatch(const GLfloat *dirs, std::size_t n, GLuint order, GLuint *ids, sphereIndex::kernel k)
+{
+#ifdef SPHERE_INDEX_X86
+    if(resolve(k) == sphereIndex::kernel::avx2){
+        descendAVX2(dirs, n, order, ids);
+        return;
+    }
+#else
+    resolve(k);
+#endif
+    descendScalar(dirs, n, order, ids);
+}
+
+const char* sphereIndex::name(kernel k)
+{
+    return resolve(k) == kernel::avx2 ? "avx2" : "scalar";
+}
+
+// the order comes from the number of triangles, then each triangle's centre
+// is walked down the tree to find the builder's number for it
+sphereIndex::sphereIndex(bufView<GLfloat> verts, bufView<GLuint> inds):verts(verts), inds(inds), order(0)
+{
+    const std::size_t nTri = inds.size() / 3;
+    while(order < 14 && (std::size_t(8) << 2 * order) < nTri) ++order;
+    if(inds.size() % 3 || nTri != std::size_t(8) << 2 * order)
+        throw std::runtime_error("Error: sphereIndex::sphereIndex(), the indices are not a whole order of the sphere");
+    perm.assign(nTri, none);
+    std::vector<GLfloat> centres(3 * batch);
+    std::vector<GLuint> ids(batch);
+    bool same = true;
+    for(std::size_t t=0; t<nTri; t+=batch){
+        const std::size_t m = std::min(batch, nTri - t);
+        for(std::size_t j=0; j<m; ++j){
+            const GLuint *tr = &inds[3 * (t + j)];
+            for(int k=0; k<3; ++k) centres[3 * j + k] = verts[3 * tr[0] + k] + verts[3 * tr[1] + k] + verts[3 * tr[2] + k];
+        }
+        descendBatch(centres.data(), m, order, ids.data(), kernel::automatic);
+        for(std::size_t j=0; j<m; ++j){
+            if(perm[ids[j]] != none)
+                throw std::runtime_error("Error: sphereIndex::sphereIndex(), two triangles in one place, the mesh is not a subdivided octahedron");
+            perm[ids[j]] = GLuint(t + j);
+            same = same && ids[j] == t + j;
+        }
+    }
+    if(same){ // in the builder's order, the tree is all that is needed
+        perm.clear();
+        perm.shrink_to_fit();
+    }
+}
+
+GLuint sphereIndex::locate(const GLfloat *dir) const
+{
+    return mapped(descend({dir[0], dir[1], dir[2]}, order));
+}
+
+void sphereIndex::locate(const GLfloat *dirs, std::size_t n, GLuint *tris, kernel k) const
+{
+    descendBatch(dirs, n, order, tris, k);
+    if(!perm.empty()) for(std::size_t i=0; i<n; ++i) tris[i] = perm[tris[i]];
+}
+
+// where the ray first meets the unit sphere ahead of the origin, which is
+// just outside the mesh, or false when it misses the sphere and so the mesh
+static bool onSphere(const GLfloat *o, const GLfloat *d, GLfloat *p)
+{
+    const double a = double(d[0]) * d[0] + double(d[1]) * d[1] + double(d[2]) * d[2];
+    const double b = double(o[0]) * d[0] + double(o[1]) * d[1] + double(o[2]) * d[2];
+    const double c = double(o[0]) * o[0] + double(o[1]) * o[1] + double(o[2]) * o[2] - 1.0;
+    const double disc = b * b - a * c;
+    if(a == 0.0 || disc < 0.0) return false;
+    const double t0 = (-b - std::sqrt(disc)) / a, t1 = (-b + std::sqrt(disc)) / a;
+    if(t1 < 0.0) return false;
+    const double t = t0 >= 0.0 ? t0 : t1;
+    for(int k=0; k<3; ++k) p[k] = GLfloat(o[k] + t * d[k]);
+    return true;
+}
+
+// from a first guess the ray is met with the plane of the triangle, and
+// when that point is outside it the triangle that point is in is tried
+// next. A few steps reach the triangle hit, a ray going between the mesh
+// and the sphere goes round in circles and is a miss
+bool sphereIndex::walk(const GLfloat *o, const GLfloat *d, GLuint tri, hit &h) const
+{
+    for(int step=0; step<maxSteps; ++step){
+        const GLfloat *a = &verts[3 * inds[3 * tri]], *b = &verts[3 * inds[3 * tri + 1]], *c = &verts[3 * inds[3 * tri + 2]];
+        double e1[3], e2[3], tv[3];
+        for(int k=0; k<3; ++k){
+            e1[k] = double(b[k]) - a[k];
+            e2[k] = double(c[k]) - a[k];
+            tv[k] = double(o[k]) - a[k];
+        }
+        const double pv[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+        const double det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+        if(det == 0.0) return false; // the ray runs along the plane
+        const double qv[3] = {tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0]};
+        const double u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) / det;
+        const double v = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) / det;
+        const double t = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) / det;
+        if(u >= -edgeTol && v >= -edgeTol && u + v <= 1.0 + edgeTol){
+            if(t < 0.0) return false;
+            h = {tri, {GLfloat(1.0 - u - v), GLfloat(u), GLfloat(v)}, GLfloat(t)};
+            return true;
+        }
+        const GLfloat q[3] = {GLfloat(o[0] + t * d[0]), GLfloat(o[1] + t * d[1]), GLfloat(o[2] + t * d[2])};
+        const GLuint next = locate(q);
+        if(next == tri) return false;
+        tri = next;
+    }
+    return false;
+}
+
+bool sphereIndex::intersect(const GLfloat *origin, const GLfloat *dir, hit &h) const
+{
+    GLfloat p[3];
+    h.tri = none;
+    if(!onSphere(origin, dir, p)) return false;
+    return walk(origin, dir, locate(p), h);
+}
+
+// the first guesses are located together, with the batched kernel, then
+// each ray walks on from its own
+void sphereIndex::intersect(const GLfloat *origins, const GLfloat *dirs, std::size_t n, hit *hits, kernel k) const
+{
+    std::vector<GLfloat> points(3 * batch);
+    std::vector<GLuint> tris(batch);
+    std::vector<char> ahead(batch);
+    for(std::size_t i=0; i<n; i+=batch){
+        const std::size_t m = std::min(batch, n - i);
+        for(std::size_t j=0; j<m; ++j){
+            ahead[j] = onSphere(origins + 3 * (i + j), dirs + 3 * (i + j), &points[3 * j]);
+            if(!ahead[j]) std::fill(&points[3 * j], &points[3 * j] + 3, 1.0f);
+        }
+        locate(points.data(), m, tris.data(), k);
+        for(std::size_t j=0; j<m; ++j){
+            hits[i + j].tri = none;
+            if(ahead[j]) walk(origins + 3 * (i + j), dirs + 3 * (i + j), tris[j], hits[i + j]);
+        }
+    }
+}
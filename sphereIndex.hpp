@@ -0,0 +1,53 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef sphereIndexDec
+#define sphereIndexDec
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
+// Finds the triangle of a sphere mesh a direction or a ray falls in, in
+// O(order), by walking down the subdivision. The octant picks the face of the
+// octahedron, then at each order the corners' midpoints are made as the
+// builder makes them and three planes through the centre pick which of the
+// four children holds the point. The walk yields the triangle's number as
+// sphereObj numbers them, corner children of triangle i at order l are
+// 8 * 4^l + 3i + k and the middle one keeps i, so the tree needs no storage.
+// Only a mesh reordered for the vertex cache needs a permutation, one index
+// per triangle, and none is kept when the mesh is in the builder's order.
+// The mesh is not copied and must outlive the index.
+class sphereIndex
+{
+public:
+    enum class kernel { automatic, scalar, avx2 };
+    struct hit
+    {
+        GLuint tri; // triangle number in the index buffer
+        GLfloat w[3]; // barycentric weights of its three corners
+        GLfloat t; // along the ray, in units of its direction
+    };
+    static constexpr GLuint none = ~GLuint(0); // no triangle, for rays that miss
+
+    sphereIndex(bufView<GLfloat> verts, bufView<GLuint> inds); // xyz per vertex, a whole order from sphere::build
+    GLuint locate(const GLfloat *dir) const; // dir need not be unit length
+    void locate(const GLfloat *dirs, std::size_t n, GLuint *tris, kernel k = kernel::automatic) const; // n xyz triples
+    // the first triangle hit by a ray starting outside the sphere, or the
+    // way out for one starting inside the mesh
+    bool intersect(const GLfloat *origin, const GLfloat *dir, hit &h) const;
+    void intersect(const GLfloat *origins, const GLfloat *dirs, std::size_t n, hit *hits, kernel k = kernel::automatic) const;
+    GLuint GetOrder() const { return order; }
+    GLuint64 bytes() const { return perm.size() * sizeof(GLuint); } // held beyond the mesh
+    static const char* name(kernel k); // the kernel automatic would pick for automatic
+private:
+    GLuint mapped(GLuint id) const { return perm.empty() ? id : perm[id]; }
+    bool walk(const GLfloat *origin, const GLfloat *dir, GLuint tri, hit &h) const;
+    bufView<GLfloat> verts;
+    bufView<GLuint> inds;
+    GLuint order;
+    std::vector<GLuint> perm; // builder's number to the mesh's, empty when they are the same
+};
+
+#endif
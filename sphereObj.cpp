@@ -7,104 +7,257 @@
 #include <GL/glew.h>
 #include <vector>
 #include <array>
-#include <stack>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include "simdNorm.hpp"
+#include "vcache.hpp"
 #include "sphereObj.hpp"
 
 // two short functions for use by the constructor's initiallisation list
+// closed forms, 64 bit so the counts for high orders do not overflow
 auto nv(GLuint n){ // calculate the final number of vertices
-    GLuint nverts = 6, ntri_half = 4;
-    
-    for(GLuint i=0; i<n; ++i){
-        nverts += 3 * ntri_half;
-        ntri_half *= 4;
-    }
-    return nverts;
+    return (GLuint64(4) << 2 * n) + 2; // 4^(n+1) + 2
 };
 
 auto nt(GLuint n){ // calculate the final number of triangles
-    GLuint ntri = 8;
-    
-    for(GLuint i=0; i<n; ++i) ntri *= 4;
-    return ntri;
+    return GLuint64(8) << 2 * n; // 8 * 4^n
 };
 ////////////////////////////////////////////////////////////////////////
 
 
 // Now the constructor
-sphereObj::sphereObj(GLuint n):order(n), nVerts(nv(n)), nTri(nt(n))
+sphereObj::sphereObj(GLuint n, GLuint nThreads, bool levels):order(n), levels(levels), nVerts(nv(n)), nTri(nt(n)),
+    pool(nThreads)
 {
-    std::cout << "sphere: nverts = " << nVerts << ", ntri = " << nTri << std::endl;
+    std::cout << "sphere: nverts = " << nVerts << ", ntri = " << nTri;
+    std::cout << ", buffer memory = " << (bytes(n) >> 20) << " MB" << std::endl;
     verts.resize(3 * nVerts);
-    trigs.resize(nTri); 
+    // the vertex indices of each level are written straight into the index
+    // buffer, so the last level leaves it ready to draw
+    inds.resize(3 * nTri);
+    index = inds.data();
+    // the rest of the triangle topology lives in one arena, the previous
+    // level arrays only ever hold the triangles of the level being divided 
+    const std::size_t nTopo = 3 * nTri, nPrev = 3 * (nTri / 4);
+    arena = std::make_unique<GLuint[]>(topoSize(n));
+    neigh = arena.get();
+    prevIndex = neigh + nTopo;
+    prevNeigh = prevIndex + nPrev;
+    chunkBase.resize(pool.size() + 1);
     triCnt = triCntOld = 8;
     vertCnt = vertCntOld = 6;
-    //triangle::initStatics();
     octahedron();  
     // next divide each triangle into four new triangles, and repeat 'order' times
-    for(int i=0; i<order; ++i) triDivide();
+    for(GLuint i=0; i<order; ++i){
+        if(levels) keepIndices();
+        triDivide();
+    }
+    if(levels){
+        // vertices keep their numbers from level to level, so one vertex buffer
+        // serves all the levels packed into the index buffer
+        keepIndices();
+        inds.swap(levelInds);
+        std::vector<GLuint>().swap(levelInds);
+        index = inds.data() + levelOffset(order);
+    }
 }
 
+// appends the current level's indices to levelInds
+void sphereObj::keepIndices()
+{
+    if(levelInds.empty()) levelInds.reserve(levelOffset(order + 1));
+    levelInds.insert(levelInds.end(), index, index + 3 * std::size_t(triCnt));
+}
 
-void sphereObj::triDivide()
+// continues dividing from the current order up to order n, growing the
+// buffers rather than starting over from the octahedron. Vertices keep their
+// numbers and the new ones follow them, so only those need uploading, but
+// every triangle changes. Needs the topology, so not after optimize()
+void sphereObj::refine(GLuint n)
 {
-    // step 1: new vertices and new indices, put old indices on stack, call neighbours
-    {
-        GLuint i, j, neighTri;
-        GLuint iv, jv;
-        const GLuint key1[] = {0, 1, 0}, key2[] = {2, 2, 1}, keyN[] = {1, 0, 2};
-        GLfloat x, y, z, r;
-        
-        for(i=0; i<triCntOld; ++i){
-            auto &tr = trigs.at(i);
-            tr.push_stack();
-            for(j=0; j<3; ++j){
-                // is this neighbour's index less than us??
-                neighTri = tr.getNeigh_tri(j);
-                if(neighTri < i){ // new vertex already made
-                    auto &tr2 = trigs.at(neighTri);
-                    iv = tr2.getIndex(keyN[j]);
-                    tr.putIndex(j, iv);
-                }
-                else{
-                    // first add 3 vertices to static vertex vector
-                    // and store their indices
-                    iv = tr.top_stack(key1[j]); // old vertex indices
-                    jv = tr.top_stack(key2[j]);  
-                    tr.putIndex(j, vertCnt);  
-                    newVertex(iv, jv); // increments vertCnt
-                }
-            }          
-        }
+    if(!hasTopology() || levels)
+        throw std::runtime_error("Error: sphereObj::refine(), needs the topology of a single order sphere");
+    if(n < order){
+        std::ostringstream oss;
+        oss << "Error: sphereObj::refine(" << n << "), the sphere is already order " << order;
+        throw std::runtime_error(oss.str());
     }
+    if(n == order) return;
+    const GLuint from = order;
+    order = n;
+    nVerts = nv(n);
+    nTri = nt(n);
+    std::cout << "sphere: refining to nverts = " << nVerts << ", ntri = " << nTri << std::endl;
+    verts.resize(3 * nVerts);
+    inds.resize(3 * nTri);
+    index = inds.data();
+    // only the neighbours carry over, the previous level arrays are refilled
+    auto grown = std::make_unique<GLuint[]>(topoSize(n));
+    std::copy(neigh, neigh + 3 * std::size_t(triCnt), grown.get());
+    arena = std::move(grown);
+    neigh = arena.get();
+    prevIndex = neigh + 3 * nTri;
+    prevNeigh = prevIndex + 3 * (nTri / 4);
+    for(GLuint i=from; i<order; ++i) triDivide();
+}
+
+// bytes needed by the buffers of an order n sphere, all are sized up front
+GLuint64 sphereObj::bytes(GLuint n)
+{
+    return 3 * nv(n) * sizeof(GLfloat) + (3 * nt(n) + topoSize(n)) * sizeof(GLuint);
+}
+
+// GLuints in the topology arena, neighbours plus the previous level
+GLuint64 sphereObj::topoSize(GLuint n)
+{
+    return 3 * nt(n) + 2 * 3 * (nt(n) / 4);
+}
+
+// reorders the triangles for the post-transform vertex cache, then the
+// vertices into the order they are first used, the topology no longer
+// matches the mesh so it is dropped. Packed levels share their vertices
+// so only the triangles of each level are reordered
+void sphereObj::optimize(GLuint cacheSize)
+{
+    dropTopology();
+    if(levels){
+        for(GLuint l=0; l<=order; ++l)
+            vcache::optimize(inds.data() + levelOffset(l), 3 * nt(l), nv(l), cacheSize);
+        return;
+    }
+    vcache::optimize(inds.data(), inds.size(), nVerts, cacheSize);
+    vcache::fetchReorder(verts.data(), 3, inds.data(), inds.size(), nVerts);
+}
+
+// frees the neighbours and previous level, only the mesh itself is kept
+void sphereObj::dropTopology()
+{
+    arena.reset();
+    neigh = prevIndex = prevNeigh = nullptr;
+}
+
+
+// each level is divided in passes over contiguous ranges of the old triangles,
+// the ranges run in parallel when there are enough triangles to share out
+void sphereObj::triDivide()
+{
+    // step 1: keep the old level and count the new vertices each range owns
+    parallel([this](GLuint t, GLuint b, GLuint e){ chunkBase[t + 1] = keepLevel(b, e); });
+    // a prefix sum numbers the new vertices exactly as a serial pass would
+    chunkBase[0] = vertCnt;
+    for(GLuint t=0; t<nChunks; ++t) chunkBase[t + 1] += chunkBase[t];
+    // step 2: new vertices and new indices, then the vertices made by neighbours
+    parallel([this](GLuint t, GLuint b, GLuint e){ newVertices(b, e, chunkBase[t]); });
+    parallel([this](GLuint, GLuint b, GLuint e){ sharedVertices(b, e); });
+    vertCnt = chunkBase[nChunks];
     // new vertices done
     
-    // step 2: new triangles, each existing triangle goes to the centre
-    {
-        for(int i=0; i<triCntOld; ++i){
-            // set new neighbouring triangles
-            auto &tr = trigs.at(i); 
-            tr.putNeigh_tri(0, triCnt++); 
-            tr.putNeigh_tri(1, triCnt++); 
-            tr.putNeigh_tri(2, triCnt++); 
-            // set vertex indices on new neighbouring triangles 
-            setIndex(tr); // one stack pop so index is now on top 
-        }
-        // now the new triagles must find their neighbours
-        for(int i=0; i<triCntOld; ++i){
+    // step 3: new triangles, each existing triangle goes to the centre
+    parallel([this](GLuint, GLuint b, GLuint e){ newTrigs(b, e); });
+    // now the new triagles must find their neighbours
+    parallel([this](GLuint, GLuint b, GLuint e){
+        for(GLuint i=b; i<e; ++i){
             newNeighbours(i, 0);
             newNeighbours(i, 1);
             newNeighbours(i, 2);
         }
-        for(int i=0; i<triCntOld; ++i){
-            auto &tr = trigs.at(i);
-            tr.pop_stack(); 
+    });
+    triCnt = 4 * triCntOld;
+    vertCntOld = vertCnt;
+    triCntOld = triCnt;
+}
+
+// splits the old triangles into one range per worker and runs job on them,
+// small levels are not worth waking the workers for
+void sphereObj::parallel(const std::function<void(GLuint, GLuint, GLuint)> &job)
+{
+    const GLuint minChunk = 4096;
+    const GLuint64 n = triCntOld;
+    
+    nChunks = pool.size();
+    if(n < GLuint64(minChunk) * nChunks) nChunks = 1;
+    if(nChunks == 1){
+        job(0, 0, triCntOld);
+        return;
+    }
+    pool.run([this, n, &job](GLuint t){
+        if(t >= nChunks) return;
+        job(t, n * t / nChunks, n * (t + 1) / nChunks);
+    });
+}
+
+// copies triangles [b, e) to the previous level arrays and returns how
+// many new vertices they make, a triangle makes the vertex on each edge
+// it shares with a higher numbered neighbour
+GLuint sphereObj::keepLevel(GLuint b, GLuint e)
+{
+    GLuint cnt = 0;
+    
+    std::copy(index + 3 * std::size_t(b), index + 3 * std::size_t(e), prevIndex + 3 * std::size_t(b));
+    std::copy(neigh + 3 * std::size_t(b), neigh + 3 * std::size_t(e), prevNeigh + 3 * std::size_t(b));
+    for(GLuint i=b; i<e; ++i){
+        const GLuint *nb = neigh + 3 * std::size_t(i);
+        for(GLuint j=0; j<3; ++j) if(nb[j] > i) ++cnt;
+    }
+    return cnt;
+}
+
+// makes the new vertices owned by triangles [b, e), numbered from vert
+// the midpoints are gathered first then normalised as one batch
+void sphereObj::newVertices(GLuint b, GLuint e, GLuint vert)
+{
+    const GLuint key1[] = {0, 1, 0}, key2[] = {2, 2, 1};
+    const GLuint first = vert;
+    
+    for(GLuint i=b; i<e; ++i){
+        GLuint *tr = index + 3 * std::size_t(i);
+        const GLuint *old = prevIndex + 3 * std::size_t(i);
+        const GLuint *nb = neigh + 3 * std::size_t(i);
+        for(GLuint j=0; j<3; ++j){
+            if(nb[j] < i) continue; // made by the neighbour
+            // new vertex half way between two old vertices
+            tr[j] = vert;
+            newVertex(vert++, old[key1[j]], old[key2[j]]);
         }
-        vertCntOld = vertCnt;
-        triCntOld = triCnt;
+    }
+    simdNorm::normalize(verts.data() + 3 * std::size_t(first), vert - first);
+}
+
+// picks up the new vertices which lower numbered neighbours made
+void sphereObj::sharedVertices(GLuint b, GLuint e)
+{
+    const GLuint keyN[] = {1, 0, 2};
+    
+    for(GLuint i=b; i<e; ++i){
+        GLuint *tr = index + 3 * std::size_t(i);
+        const GLuint *nb = neigh + 3 * std::size_t(i);
+        for(GLuint j=0; j<3; ++j){
+            // is this neighbour's index less than us??
+            if(nb[j] < i) tr[j] = index[3 * std::size_t(nb[j]) + keyN[j]];
+        }
+    }
+}
+
+// the three new triangles made from triangle i are numbered
+// triCntOld + 3 * i onwards, just as if they were counted serially
+void sphereObj::newTrigs(GLuint b, GLuint e)
+{
+    for(GLuint i=b; i<e; ++i){
+        // set new neighbouring triangles
+        GLuint *nb = neigh + 3 * std::size_t(i);
+        GLuint t = triCntOld + 3 * i;
+        nb[0] = t; 
+        nb[1] = t + 1; 
+        nb[2] = t + 2; 
+        // set vertex indices on new neighbouring triangles 
+        setIndex(i);
     }
 }
 
@@ -118,17 +271,17 @@ void sphereObj::newNeighbours(GLuint itr, GLuint i)
                         {1, 2, 0},
                         {0, 1, 2} };
     
-    auto &tr = trigs.at(itr);
-    subj = tr.getNeigh_tri(i); // subject triangle index
-    auto &tr_subj = trigs.at(subj); // subject triangle
-    pivot = tr_subj.getIndex(i); // subject's signiture vertex, used to id it
-    j = tr.top_stack(key1[i]); // old central neighbouring triangle
+    const GLuint *old = prevNeigh + 3 * std::size_t(itr);
+    subj = neigh[3 * std::size_t(itr) + i]; // subject triangle index
+    GLuint *nb_subj = neigh + 3 * std::size_t(subj); // subject triangle's neighbours
+    pivot = index[3 * std::size_t(subj) + i]; // subject's signiture vertex, used to id it
+    j = old[key1[i]]; // old central neighbouring triangle
     k = getTrig(j, pivot);
-    tr_subj.putNeigh_tri(map[i][0], k);
-    j = tr.top_stack(key2[i]); // old central neighbour triangle
+    nb_subj[map[i][0]] = k;
+    j = old[key2[i]]; // old central neighbour triangle
     k = getTrig(j, pivot);                
-    tr_subj.putNeigh_tri(map[i][1], k);
-    tr_subj.putNeigh_tri(map[i][2], itr);
+    nb_subj[map[i][1]] = k;
+    nb_subj[map[i][2]] = itr;
 }
 
 // returns the new triangle which is a neighbour to pivot
@@ -138,74 +291,51 @@ GLuint sphereObj::getTrig(GLuint itr, GLuint pivot)
     GLuint i, j, k;
 
     for(i=0; i<3; ++i){
-        j = trigs.at(itr).getNeigh_tri(i); // neighbouring triangle
-        k = trigs.at(j).getIndex(i); // pivot of neighbouring triangle
+        j = neigh[3 * std::size_t(itr) + i]; // neighbouring triangle
+        k = index[3 * std::size_t(j) + i]; // pivot of neighbouring triangle
         if(k == pivot) return j;
     }
     std::ostringstream oss;
-    oss << "Error: triangle::getTrig(GLuint, GLuint), failed to find pivot " << pivot << '.';
+    oss << "Error: sphereObj::getTrig(GLuint, GLuint), failed to find pivot " << pivot << '.';
     std::string str =  oss.str();
     throw std::runtime_error(str);
 }
 
 // sets the indices to the vertices for the new triangles
-void sphereObj::setIndex(triangle &tr)
+// made from triangle itr, the previous level still holds its old indices
+void sphereObj::setIndex(GLuint itr)
 {    
-    auto &t0 = trigs.at(tr.getNeigh_tri(0));
-    auto &t1 = trigs.at(tr.getNeigh_tri(1));
-    auto &t2 = trigs.at(tr.getNeigh_tri(2));
-    t0.putIndex(0, tr.top_stack(0));
-    t0.putIndex(1, tr.getIndex(2));
-    t0.putIndex(2, tr.getIndex(0));
+    const GLuint *tr = index + 3 * std::size_t(itr);
+    const GLuint *old = prevIndex + 3 * std::size_t(itr);
+    const GLuint *nb = neigh + 3 * std::size_t(itr);
+    GLuint *t0 = index + 3 * std::size_t(nb[0]);
+    GLuint *t1 = index + 3 * std::size_t(nb[1]);
+    GLuint *t2 = index + 3 * std::size_t(nb[2]);
+    t0[0] = old[0];
+    t0[1] = tr[2];
+    t0[2] = tr[0];
     
-    t1.putIndex(0, tr.getIndex(2));
-    t1.putIndex(1, tr.top_stack(1));
-    t1.putIndex(2, tr.getIndex(1));
+    t1[0] = tr[2];
+    t1[1] = old[1];
+    t1[2] = tr[1];
 
-    t2.putIndex(0, tr.getIndex(0));
-    t2.putIndex(1, tr.getIndex(1));
-    t2.putIndex(2, tr.top_stack(2));
-    tr.pop_stack();
+    t2[0] = tr[0];
+    t2[1] = tr[1];
+    t2[2] = old[2];
 }
 
 
-// adds a new unit vertex which is half way
-// between vertex j & k
-void sphereObj::newVertex(GLuint j, GLuint k)
+// makes vertex iv the sum of vertex j & k, which is half way between
+// them once it is scaled to unit length by simdNorm::normalize()
+void sphereObj::newVertex(GLuint iv, GLuint j, GLuint k)
 {
-    GLfloat x, y, z, r;
-    GLuint i = 3 * vertCnt++;
+    GLfloat *v = verts.data() + 3 * std::size_t(iv);
+    const GLfloat *vj = verts.data() + 3 * std::size_t(j);
+    const GLfloat *vk = verts.data() + 3 * std::size_t(k);
     
-    j *= 3;
-    k *= 3;
-    auto vj = verts.at(j++);
-    auto vk = verts.at(k++);
-    x = vj + vk;
-    vj = verts.at(j++);
-    vk = verts.at(k++);
-    y = vj + vk;
-    vj = verts.at(j);
-    vk = verts.at(k);
-    z = vj + vk;    
-    r = sqrt(x * x + y * y + z * z);
-    verts.at(i++) = x / r;
-    verts.at(i++) = y / r;
-    verts.at(i) = z / r;
-}
-
-// return full buffer of indices
-const std::vector<GLuint>& sphereObj::GetInds()
-{  
-    GLuint nInds = 3 * trigs.size();
-    inds.resize(nInds);
-    int i = 0, j = 0;
-    for(auto tr: trigs){
-        auto &index = tr.getIndex();
-        inds.at(j++) = index.at(0);
-        inds.at(j++) = index.at(1);
-        inds.at(j++) = index.at(2);
-    } 
-    return inds;
+    v[0] = vj[0] + vk[0];
+    v[1] = vj[1] + vk[1];
+    v[2] = vj[2] + vk[2];
 }
 
 void sphereObj::octahedron()
@@ -238,11 +368,26 @@ void sphereObj::octahedron()
         kt = (i + 1) % 4;
         jv = i + 2;
         kv = (i + 1) % 4 + 2;
-        trigs.at(i).set(jt, kt, i+4, jv, kv, 0);
-        trigs.at(i+4).set(jt+4, kt+4, i, jv, kv, 1);    
+        setTrig(i, jt, kt, i+4, jv, kv, 0);
+        setTrig(i+4, jt+4, kt+4, i, jv, kv, 1);    
     }    
 }
 
+// indices of neighbouring triangles, and vertices
+void sphereObj::setTrig(GLuint itr, GLuint t0, GLuint t1, GLuint t2, GLuint v0, GLuint v1, GLuint v2)
+{
+    GLuint *nb = neigh + 3 * std::size_t(itr), *tr = index + 3 * std::size_t(itr);
+    
+    // 3 indices of neighbouring triangles
+    nb[0] = t0; 
+    nb[1] = t1; 
+    nb[2] = t2; 
+    // 3 indices to vetercies which form triangle
+    tr[0] = v0;
+    tr[1] = v1;
+    tr[2] = v2; 
+}
+
 
 
 
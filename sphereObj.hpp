@@ -5,33 +5,57 @@
 #ifndef sphereObjDec
 #define sphereObjDec
 
-class triangle;
+#ifndef workPoolDec
+#include "workPool.hpp"
+#endif
 
 class sphereObj
 {
 public:
-    sphereObj(GLuint n);
-    const std::vector<GLuint>& GetInds();
+    sphereObj(GLuint n, GLuint nThreads = 1, bool levels = false);
+    const std::vector<GLuint>& GetInds(){ return inds; }
     const std::vector<GLfloat>& GetVerts(){ return verts; }
-    GLuint GetNInds(){ return 3 * nTri; }
+    GLuint64 GetNInds(){ return 3 * nTri; }
+    static GLuint64 bytes(GLuint n);
+    static GLuint64 levelOffset(GLuint level){ return 8 * ((GLuint64(1) << 2 * level) - 1); }
+    void dropTopology();
+    void optimize(GLuint cacheSize);
+    void refine(GLuint n); // on up to order n, vertex numbers are kept
+    GLuint GetOrder(){ return order; }
+    bool hasTopology(){ return arena != nullptr; }
+    bool isLevelPacked(){ return levels; } // every order up to this one, which cannot be refined
 private:
     void octahedron(); 
+    void setTrig(GLuint itr, GLuint t0, GLuint t1, GLuint t2, GLuint v0, GLuint v1, GLuint v2);
     void triDivide();
+    void parallel(const std::function<void(GLuint, GLuint, GLuint)> &job);
+    GLuint keepLevel(GLuint b, GLuint e);
+    void newVertices(GLuint b, GLuint e, GLuint vert);
+    void sharedVertices(GLuint b, GLuint e);
+    void newTrigs(GLuint b, GLuint e);
     void newNeighbours(GLuint itr, GLuint i);
     GLuint getTrig(GLuint itr, GLuint pivot);
-    void setIndex(triangle &tr);
-    void newVertex(GLuint j, GLuint k);
+    void setIndex(GLuint itr);
+    void newVertex(GLuint iv, GLuint j, GLuint k);
+    static GLuint64 topoSize(GLuint n);
+    void keepIndices();
     
     // private data
     std::vector<GLfloat> verts;
-    std::vector<triangle> trigs;
-    std::vector<GLuint> inds;
-    const GLuint order, nVerts, nTri;
+    std::vector<GLuint> inds; // 3 vertex indices per triangle
+    std::vector<GLuint> levelInds; // the indices of every level, lowest first
+    // triangle topology, structure of arrays with 3 entries per triangle
+    std::unique_ptr<GLuint[]> arena;
+    GLuint *index, *neigh; // index points into inds, neighbouring triangles
+    GLuint *prevIndex, *prevNeigh; // the same for the level being divided
+    GLuint order;
+    const bool levels; // inds holds every level from 0 to order
+    GLuint64 nVerts, nTri;
     GLuint triCnt, triCntOld, vertCnt, vertCntOld;
+    // threads for the subdivision, and where each range's new vertices start
+    workPool pool;
+    std::vector<GLuint> chunkBase;
+    GLuint nChunks;
 };
 
 #endif
-
-#ifndef triangleDec
-#include "triangle.hpp"
-#endif
@@ -0,0 +1,246 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <array>
+#include <memory>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "sphereTables.hpp"
+#include "sphereObj.hpp"
+#include "simdNorm.hpp"
+
+constexpr std::size_t cnv(GLuint n){ return (std::size_t(4) << 2 * n) + 2; }
+constexpr std::size_t cnt(GLuint n){ return std::size_t(8) << 2 * n; }
+
+// unit of least precision above positive normal x, and below it
+constexpr float ulpUp(float x)
+{
+    float p = 1.0f;
+    
+    while(p > x) p *= 0.5f;
+    while(p * 2.0f <= x) p *= 2.0f;
+    return p / 8388608.0f; // p / 2^23
+}
+
+constexpr float ulpDown(float x)
+{
+    float u = ulpUp(x);
+    return x == u * 8388608.0f ? u * 0.5f : u;
+}
+
+// correctly rounded square root, as sqrt() gives at run time
+constexpr float csqrt(float a)
+{
+    double x = a > 1.0f ? a : 1.0, last = 0.0;
+    
+    for(int i=0; i<100 && x != last; ++i){
+        last = x;
+        x = 0.5 * (x + a / x);
+    }
+    // products of floats with 25 bit mantissas are exact in double
+    float r = static_cast<float>(x);
+    for(;;){
+        double up = double(r) + 0.5 * double(ulpUp(r));
+        double down = double(r) - 0.5 * double(ulpDown(r));
+        if(up * up <= a) r += ulpUp(r);
+        else if(down * down > a) r -= ulpDown(r);
+        else return r;
+    }
+}
+
+template<GLuint N>
+struct bakedMesh
+{
+    std::array<GLfloat, 3 * cnv(N)> verts{};
+    std::array<GLuint, 3 * cnt(N)> inds{};
+    std::array<GLushort, 3 * cnt(N)> inds16{};
+};
+
+// the same steps as sphereObj's octahedron() and triDivide(), run serially
+template<GLuint N>
+constexpr bakedMesh<N> bake()
+{
+    bakedMesh<N> m;
+    std::array<GLuint, 3 * cnt(N)> neigh{};
+    std::array<GLuint, 3 * cnt(N) / 4 + 3> prevIndex{}, prevNeigh{};
+    auto &verts = m.verts;
+    auto &index = m.inds;
+    const GLuint key1[] = {0, 1, 0}, key2[] = {2, 2, 1}, keyN[] = {1, 0, 2};
+    const GLuint map[][3] = { {0, 2, 1},
+                              {1, 2, 0},
+                              {0, 1, 2} };
+    const GLfloat oct[] = {0, 0, 1,  0, 0, -1,  1, 0, 0,  0, 1, 0,  -1, 0, 0,  0, -1, 0};
+    
+    for(GLuint i=0; i<18; ++i) verts[i] = oct[i];
+    for(GLuint i=0; i<4; ++i){
+        const GLuint jt = (i + 3) % 4, kt = (i + 1) % 4, jv = i + 2, kv = (i + 1) % 4 + 2;
+        const GLuint t[2][6] = { {jt, kt, i + 4, jv, kv, 0}, {jt + 4, kt + 4, i, jv, kv, 1} };
+        for(GLuint h=0; h<2; ++h){
+            for(GLuint j=0; j<3; ++j){
+                neigh[3 * (i + 4 * h) + j] = t[h][j];
+                index[3 * (i + 4 * h) + j] = t[h][j + 3];
+            }
+        }
+    }
+    
+    GLuint triCnt = 8, vertCnt = 6;
+    for(GLuint level=0; level<N; ++level){
+        const GLuint triOld = triCnt;
+        for(GLuint k=0; k<3*triOld; ++k){
+            prevIndex[k] = index[k];
+            prevNeigh[k] = neigh[k];
+        }
+        // new vertices, normalised straight away as the scalar kernel does
+        for(GLuint i=0; i<triOld; ++i){
+            for(GLuint j=0; j<3; ++j){
+                const GLuint nb = neigh[3 * i + j];
+                if(nb < i){
+                    index[3 * i + j] = index[3 * nb + keyN[j]];
+                    continue;
+                }
+                const GLuint a = 3 * prevIndex[3 * i + key1[j]], b = 3 * prevIndex[3 * i + key2[j]];
+                const GLfloat x = verts[a] + verts[b], y = verts[a + 1] + verts[b + 1], z = verts[a + 2] + verts[b + 2];
+                const GLfloat r = csqrt(x * x + y * y + z * z);
+                verts[3 * vertCnt] = x / r;
+                verts[3 * vertCnt + 1] = y / r;
+                verts[3 * vertCnt + 2] = z / r;
+                index[3 * i + j] = vertCnt++;
+            }
+        }
+        // new triangles and their vertices
+        for(GLuint i=0; i<triOld; ++i){
+            const GLuint c = triOld + 3 * i;
+            const GLuint *old = &prevIndex[3 * i];
+            const GLuint tr[] = {index[3 * i], index[3 * i + 1], index[3 * i + 2]};
+            const GLuint child[3][3] = { {old[0], tr[2], tr[0]},
+                                         {tr[2], old[1], tr[1]},
+                                         {tr[0], tr[1], old[2]} };
+            for(GLuint k=0; k<3; ++k){
+                neigh[3 * i + k] = c + k;
+                for(GLuint j=0; j<3; ++j) index[3 * (c + k) + j] = child[k][j];
+            }
+        }
+        // and their neighbours, getTrig() inlined
+        for(GLuint itr=0; itr<triOld; ++itr){
+            for(GLuint i=0; i<3; ++i){
+                const GLuint subj = neigh[3 * itr + i], pivot = index[3 * subj + i];
+                const GLuint olds[] = {prevNeigh[3 * itr + key1[i]], prevNeigh[3 * itr + key2[i]]};
+                for(GLuint s=0; s<2; ++s){
+                    GLuint found = ~0u;
+                    for(GLuint q=0; q<3; ++q){
+                        const GLuint jt = neigh[3 * olds[s] + q];
+                        if(index[3 * jt + q] == pivot) found = jt;
+                    }
+                    if(found == ~0u) throw std::logic_error("sphereTables: bake(), pivot not found");
+                    neigh[3 * subj + map[i][s]] = found;
+                }
+                neigh[3 * subj + map[i][2]] = itr;
+            }
+        }
+        triCnt = 4 * triOld;
+    }
+    static_assert(cnv(N) <= 65536, "sphereTables: a baked mesh must fit 16 bit indices");
+    for(std::size_t k=0; k<index.size(); ++k) m.inds16[k] = static_cast<GLushort>(index[k]);
+    return m;
+}
+
+static constexpr auto mesh0 = bake<0>();
+static constexpr auto mesh1 = bake<1>();
+static constexpr auto mesh2 = bake<2>();
+static constexpr auto mesh3 = bake<3>();
+static constexpr auto mesh4 = bake<4>();
+static_assert(sphereTables::maxOrder == 4, "sphereTables: bake a table for every order up to maxOrder");
+
+bufView<GLfloat> sphereTables::GetVerts(GLuint order)
+{
+    switch(order){
+        case 0: return bufView<GLfloat>(mesh0.verts.data(), mesh0.verts.size());
+        case 1: return bufView<GLfloat>(mesh1.verts.data(), mesh1.verts.size());
+        case 2: return bufView<GLfloat>(mesh2.verts.data(), mesh2.verts.size());
+        case 3: return bufView<GLfloat>(mesh3.verts.data(), mesh3.verts.size());
+        case 4: return bufView<GLfloat>(mesh4.verts.data(), mesh4.verts.size());
+    }
+    throw std::runtime_error("Error: sphereTables::GetVerts(), no table for order " + std::to_string(order));
+}
+
+bufView<GLuint> sphereTables::GetInds(GLuint order)
+{
+    switch(order){
+        case 0: return bufView<GLuint>(mesh0.inds.data(), mesh0.inds.size());
+        case 1: return bufView<GLuint>(mesh1.inds.data(), mesh1.inds.size());
+        case 2: return bufView<GLuint>(mesh2.inds.data(), mesh2.inds.size());
+        case 3: return bufView<GLuint>(mesh3.inds.data(), mesh3.inds.size());
+        case 4: return bufView<GLuint>(mesh4.inds.data(), mesh4.inds.size());
+    }
+    throw std::runtime_error("Error: sphereTables::GetInds(), no table for order " + std::to_string(order));
+}
+
+bufView<GLushort> sphereTables::GetInds16(GLuint order)
+{
+    switch(order){
+        case 0: return bufView<GLushort>(mesh0.inds16.data(), mesh0.inds16.size());
+        case 1: return bufView<GLushort>(mesh1.inds16.data(), mesh1.inds16.size());
+        case 2: return bufView<GLushort>(mesh2.inds16.data(), mesh2.inds16.size());
+        case 3: return bufView<GLushort>(mesh3.inds16.data(), mesh3.inds16.size());
+        case 4: return bufView<GLushort>(mesh4.inds16.data(), mesh4.inds16.size());
+    }
+    throw std::runtime_error("Error: sphereTables::GetInds16(), no table for order " + std::to_string(order));
+}
+
+// distance between two floats in units of least precision
+static GLuint ulps(GLfloat a, GLfloat b)
+{
+    std::int32_t i, j;
+    std::memcpy(&i, &a, sizeof(i));
+    std::memcpy(&j, &b, sizeof(j));
+    // sign and magnitude to a single ordered scale
+    const std::int64_t x = i < 0 ? -std::int64_t(i & 0x7fffffff) : i, y = j < 0 ? -std::int64_t(j & 0x7fffffff) : j;
+    return GLuint(std::min<std::int64_t>(x > y ? x - y : y - x, ~GLuint(0)));
+}
+
+// the tables must match a runtime build bit for bit, so the runtime
+// build here uses the scalar kernel the tables were made with. How far the
+// kernel in use drifts from them is measured beside, it is not a failure
+bool sphereTables::check()
+{
+    const simdNorm::kernel was = simdNorm::current();
+    const std::string wasName = simdNorm::name();
+    bool ok = true;
+    
+    for(GLuint n=0; n<=maxOrder; ++n){
+        simdNorm::force(simdNorm::kernel::scalar);
+        sphereObj obj(n);
+        const auto &verts = obj.GetVerts();
+        const auto &inds = obj.GetInds();
+        auto bv = GetVerts(n);
+        auto bi = GetInds(n);
+        auto bi16 = GetInds16(n);
+        bool same = bv.size() == verts.size() && bi.size() == inds.size() && bi16.size() == inds.size()
+            && std::equal(bv.begin(), bv.end(), verts.begin()) && std::equal(bi.begin(), bi.end(), inds.begin())
+            && std::equal(bi16.begin(), bi16.end(), inds.begin());
+        ok = ok && same;
+        simdNorm::force(was);
+        std::string drift;
+        if(was != simdNorm::kernel::scalar){
+            sphereObj fast(n);
+            const auto &fv = fast.GetVerts();
+            GLuint worst = 0;
+            for(std::size_t i=0; i<bv.size() && i<fv.size(); ++i) worst = std::max(worst, ulps(bv[i], fv[i]));
+            drift = ", the " + wasName + " kernel's vertices are within " + std::to_string(worst) + " ulp of it";
+        }
+        std::cout << "sphereTables: order " << n << (same ? " matches" : " DIFFERS FROM") << " the runtime build" << drift << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,24 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef sphereTablesDec
+#define sphereTablesDec
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
+// Meshes for the low orders, generated by the compiler and baked into the
+// binary. They follow sphereObj exactly, with the scalar normalisation.
+namespace sphereTables
+{
+    const GLuint maxOrder = 4;
+    
+    bufView<GLfloat> GetVerts(GLuint order);
+    bufView<GLuint> GetInds(GLuint order);
+    bufView<GLushort> GetInds16(GLuint order); // every table fits in 16 bits
+    bool check(); // compares every table with a runtime build
+}
+
+#endif
@@ -0,0 +1,44 @@
+#version 400 core
+// one patch per triangle of the order 0 or 1 sphere, every edge is divided
+// into pieces tessPixels long on the screen, or tessLevel times when set
+layout (vertices = 3) out;
+
+in vec3 vPos[];
+in vec4 vPlace[];
+in vec3 vColor[];
+out vec3 tPos[];
+out vec4 tPlace[];
+out vec3 tColor[];
+
+float dz = -5.0;
+
+// a corner as the camera sees it, placed as vertex.shader places vertices
+vec3 eyePos(int i)
+{
+    vec4 p = rotate * vec4(vPlace[i].w * vPos[i], 1.0);
+    return p.xyz + vPlace[i].xyz + vec3(0.0, 0.0, dz);
+}
+
+// both patches on an edge find its level from the same two ends, in either
+// order, so they divide it alike and leave no crack
+float edgeLevel(vec3 a, vec3 b)
+{
+    if(tessLevel > 0.0) return tessLevel;
+    float depth = max(-0.5 * (a.z + b.z), 1e-3);
+    return clamp(distance(a, b) * tessScale / (depth * tessPixels), 1.0, float(gl_MaxTessGenLevel));
+}
+
+void main()
+{
+    tPos[gl_InvocationID] = vPos[gl_InvocationID];
+    tPlace[gl_InvocationID] = vPlace[gl_InvocationID];
+    tColor[gl_InvocationID] = vColor[gl_InvocationID];
+    if(gl_InvocationID == 0){
+        vec3 p0 = eyePos(0), p1 = eyePos(1), p2 = eyePos(2);
+        // each outer level is the edge opposite that corner
+        gl_TessLevelOuter[0] = edgeLevel(p1, p2);
+        gl_TessLevelOuter[1] = edgeLevel(p2, p0);
+        gl_TessLevelOuter[2] = edgeLevel(p0, p1);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+    }
+}
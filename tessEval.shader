@@ -0,0 +1,25 @@
+#version 400 core
+// the flat patch is divided evenly, then each new vertex is pushed out
+// onto the unit sphere and placed as vertex.shader places vertices
+layout (triangles, equal_spacing, ccw) in;
+
+in vec3 tPos[];
+in vec4 tPlace[];
+in vec3 tColor[];
+out vec3 Normal;
+out vec3 FragPos;
+flat out vec3 Color;
+
+float dz = -5.0;
+
+void main()
+{
+    vec3 pos = normalize(gl_TessCoord.x * tPos[0] + gl_TessCoord.y * tPos[1] + gl_TessCoord.z * tPos[2]);
+    vec4 position = rotate * vec4(tPlace[0].w * pos, 1.0);
+    position.xyz += tPlace[0].xyz; // place this instance
+    position.z += dz; // move the whole sphere
+    gl_Position = perspective * position;
+    Normal = vec3(rotate * vec4(pos, 0.0)); // the same on a unit sphere
+    FragPos = vec3(position);
+    Color = tColor[0];
+}
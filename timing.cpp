@@ -0,0 +1,216 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <array>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include "timing.hpp"
+
+namespace timing
+{
+    namespace
+    {
+        struct event
+        {
+            const char *name;
+            int tid; // 1 for the CPU, 2 for the GPU
+            double ts, dur; // microseconds
+            GLuint64 frame;
+        };
+
+        struct totals
+        {
+            double cpu = 0.0, gpu = 0.0; // microseconds
+        };
+
+        // one frame's queries, stamp 0 is taken as the frame begins and
+        // each GPU scope adds a pair after it
+        struct frameQueries
+        {
+            GLuint elapsed;
+            std::array<GLuint, 33> stamps;
+            std::vector<std::pair<const char*, GLuint>> scopes; // name and start stamp
+            GLuint used;
+            GLuint64 frame;
+            bool inFlight;
+        };
+
+        const GLuint ringSize = 4; // frames the GPU may be behind before results are lost
+        const std::size_t maxEvents = 1 << 20; // bounds the trace, the totals keep counting
+    }
+
+    static bool on = false;
+    static std::chrono::steady_clock::time_point t0;
+    static GLint64 gpu0; // GPU nanoseconds at t0
+    static std::array<frameQueries, ringSize> ring;
+    static frameQueries *current = nullptr; // between beginFrame() and endFrame()
+    static GLuint64 frame = 0, dropped = 0, gpuFrames = 0;
+    static double frameStart;
+    static std::vector<event> events;
+    static std::map<std::string, totals> sums;
+
+    static double now()
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    static void record(const char *name, int tid, double ts, double dur, GLuint64 f)
+    {
+        if(events.size() < maxEvents) events.push_back({name, tid, ts, dur, f});
+        if(tid == 1) sums[name].cpu += dur;
+        else sums[name].gpu += dur;
+    }
+
+    // reads a frame's queries into the timeline, without waiting unless
+    // wait is set, false when they are not ready yet
+    static bool collect(frameQueries &q, bool wait)
+    {
+        if(!q.inFlight) return true;
+        if(!wait){
+            GLuint ready;
+            glGetQueryObjectuiv(q.elapsed, GL_QUERY_RESULT_AVAILABLE, &ready);
+            if(!ready) return false;
+            for(GLuint i=0; i<q.used; ++i){
+                glGetQueryObjectuiv(q.stamps[i], GL_QUERY_RESULT_AVAILABLE, &ready);
+                if(!ready) return false;
+            }
+        }
+        std::array<GLuint64, 33> ns;
+        for(GLuint i=0; i<q.used; ++i) glGetQueryObjectui64v(q.stamps[i], GL_QUERY_RESULT, &ns[i]);
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(q.elapsed, GL_QUERY_RESULT, &elapsed);
+        // on the CPU's clock, offset by where the GPU's was when enabled
+        auto ts = [](GLuint64 t){ return (GLint64(t) - gpu0) * 1e-3; };
+        record("frame", 2, ts(ns[0]), elapsed * 1e-3, q.frame);
+        for(auto &s: q.scopes)
+            record(s.first, 2, ts(ns[s.second]), (GLint64(ns[s.second + 1]) - GLint64(ns[s.second])) * 1e-3, q.frame);
+        ++gpuFrames;
+        q.inFlight = false;
+        return true;
+    }
+
+    void enable()
+    {
+        if(on) return;
+        for(auto &q: ring){
+            glGenQueries(1, &q.elapsed);
+            glGenQueries(q.stamps.size(), q.stamps.data());
+            q.inFlight = false;
+        }
+        glFinish(); // so the GPU's time is now, not when queued work ends
+        glGetInteger64v(GL_TIMESTAMP, &gpu0);
+        t0 = std::chrono::steady_clock::now();
+        if(glGetError() != GL_NO_ERROR) throw std::runtime_error("Error: timing::enable(), timer queries failed");
+        on = true;
+    }
+
+    bool enabled()
+    {
+        return on;
+    }
+
+    // the slot of ringSize frames ago is read back and reused, if the GPU
+    // has still not finished with it the results are dropped rather than waited for
+    void beginFrame()
+    {
+        if(!on) return;
+        current = &ring[++frame % ringSize];
+        if(!collect(*current, false)) ++dropped;
+        current -> inFlight = false;
+        current -> frame = frame;
+        current -> scopes.clear();
+        current -> used = 1;
+        glQueryCounter(current -> stamps[0], GL_TIMESTAMP);
+        glBeginQuery(GL_TIME_ELAPSED, current -> elapsed);
+        frameStart = now();
+    }
+
+    void endFrame()
+    {
+        if(!on || !current) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        current -> inFlight = true;
+        current = nullptr;
+        record("frame", 1, frameStart, now() - frameStart, frame);
+    }
+
+    void report()
+    {
+        if(!on) return;
+        const GLuint64 cpuFrames = std::max<GLuint64>(frame, 1);
+        std::printf("%llu frames, GPU times for %llu, %llu dropped\n", (unsigned long long) frame,
+            (unsigned long long) gpuFrames, (unsigned long long) dropped);
+        std::printf("scope        CPU ms/frame  GPU ms/frame\n");
+        for(auto &s: sums){
+            std::printf("%-12s %12.3f", s.first.c_str(), s.second.cpu * 1e-3 / cpuFrames);
+            if(s.second.gpu > 0.0) std::printf(" %13.3f\n", s.second.gpu * 1e-3 / std::max<GLuint64>(gpuFrames, 1));
+            else std::printf("             -\n");
+        }
+    }
+
+    // complete events on two threads of one process, see the Trace Event Format
+    void writeTrace(const std::string &file)
+    {
+        if(!on) return;
+        for(auto &q: ring) collect(q, true);
+        std::ofstream os(file);
+        if(!os) throw std::runtime_error("Error: timing::writeTrace(), cannot write " + file);
+        os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        os << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+        os << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+        char buf[64];
+        for(auto &e: events){
+            std::snprintf(buf, sizeof(buf), "%.3f, \"dur\": %.3f", e.ts, e.dur);
+            os << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.tid
+               << ", \"ts\": " << buf << ", \"args\": {\"frame\": " << e.frame << "}}";
+        }
+        os << "\n]}\n";
+        std::cout << events.size() << " events written to " << file << std::endl;
+    }
+
+    void close()
+    {
+        if(!on) return;
+        for(auto &q: ring){
+            glDeleteQueries(1, &q.elapsed);
+            glDeleteQueries(q.stamps.size(), q.stamps.data());
+        }
+        on = false;
+        current = nullptr;
+        events.clear();
+        sums.clear();
+        frame = dropped = gpuFrames = 0;
+    }
+
+    // a GPU scope with no stamps left in its frame is timed on the CPU only
+    scope::scope(const char *name, bool gpu):name(name), query(-1)
+    {
+        if(!on) return;
+        if(gpu && current && current -> used + 2 <= current -> stamps.size()){
+            query = current -> used;
+            current -> used += 2;
+            glQueryCounter(current -> stamps[query], GL_TIMESTAMP);
+        }
+        start = now();
+    }
+
+    scope::~scope()
+    {
+        if(!on) return;
+        record(name, 1, start, now() - start, frame);
+        if(query >= 0 && current){
+            glQueryCounter(current -> stamps[query + 1], GL_TIMESTAMP);
+            current -> scopes.emplace_back(name, query);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef timingDec
+#define timingDec
+
+// Frame instrumentation. Scoped CPU timers, and GPU timestamps read back
+// from a ring of query objects a few frames later so the CPU never waits on
+// them, with a GL_TIME_ELAPSED query around each whole frame. Everything is
+// kept as a timeline which can be written in the Chrome trace JSON format,
+// for chrome://tracing or Perfetto. Off until enable() is called, when the
+// calls cost next to nothing. Needs a current GL context while enabled.
+namespace timing
+{
+    void enable(); // call once the GL context is current
+    bool enabled();
+    void beginFrame();
+    void endFrame();
+    void report(); // mean CPU and GPU milliseconds of each scope per frame
+    void writeTrace(const std::string &file); // waits for the queries still in flight
+    void close(); // frees the queries, before the context goes
+
+    // times its own lifetime on the CPU and, with gpu set, on the GPU
+    class scope
+    {
+    public:
+        scope(const char *name, bool gpu = false);
+        ~scope();
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+    private:
+        const char *name;
+        double start; // microseconds
+        GLint query; // index of the GPU start stamp, -1 for none
+    };
+}
+
+#endif
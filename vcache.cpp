@@ -0,0 +1,139 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "vcache.hpp"
+
+// a FIFO cache, which is close to what the hardware does
+vcache::stats vcache::measure(bufView<GLuint> inds, std::size_t nVerts, GLuint cacheSize)
+{
+    std::vector<GLuint64> stamp(nVerts, 0); // when each vertex entered the cache
+    GLuint64 misses = 0;
+    
+    for(GLuint v: inds){
+        // the vertex is cached if fewer than cacheSize misses happened since it entered
+        if(stamp[v] == 0 || misses - stamp[v] >= cacheSize) stamp[v] = ++misses;
+    }
+    stats s;
+    s.acmr = inds.size() ? 3.0 * misses / inds.size() : 0.0;
+    s.atvr = nVerts ? double(misses) / nVerts : 0.0;
+    return s;
+}
+
+// Forsyth's scoring, recently used vertices and vertices with few triangles
+// left to draw score highest
+static const float cacheDecayPower = 1.5f, lastTriScore = 0.75f;
+static const float valenceBoostScale = 2.0f, valenceBoostPower = 0.5f;
+
+static float vertexScore(int cachePos, GLuint remaining, GLuint cacheSize)
+{
+    if(remaining == 0) return -1.0f; // nothing left to draw with it
+    float score = 0.0f;
+    if(cachePos >= 0){
+        // the last triangle's vertices get a fixed score, so its neighbours are
+        // preferred without the strip order of the previous triangle mattering 
+        if(cachePos < 3) score = lastTriScore;
+        else score = std::pow(1.0f - float(cachePos - 3) / (cacheSize - 3), cacheDecayPower);
+    }
+    return score + valenceBoostScale * std::pow(float(remaining), -valenceBoostPower);
+}
+
+void vcache::optimize(GLuint *inds, std::size_t nInds, std::size_t nVerts, GLuint cacheSize)
+{
+    if(cacheSize < 4) throw std::runtime_error("Error: vcache::optimize(), cache size must be at least 4");
+    const std::size_t nTri = nInds / 3;
+    const GLuint none = ~0u;
+    
+    // triangles using each vertex, compressed rows
+    std::vector<GLuint> start(nVerts + 1, 0), remaining(nVerts, 0), adj(nInds);
+    for(std::size_t i=0; i<nInds; ++i) ++remaining[inds[i]];
+    for(std::size_t v=0; v<nVerts; ++v) start[v + 1] = start[v] + remaining[v];
+    {
+        std::vector<GLuint> fill(start.begin(), start.end() - 1);
+        for(std::size_t i=0; i<nInds; ++i) adj[fill[inds[i]]++] = i / 3;
+    }
+    std::vector<int> cachePos(nVerts, -1);
+    std::vector<float> vScore(nVerts), tScore(nTri);
+    std::vector<char> emitted(nTri, 0);
+    for(std::size_t v=0; v<nVerts; ++v) vScore[v] = vertexScore(-1, remaining[v], cacheSize);
+    
+    GLuint best = none;
+    float bestScore = -1.0f;
+    for(std::size_t t=0; t<nTri; ++t){
+        const GLuint *tr = inds + 3 * t;
+        tScore[t] = vScore[tr[0]] + vScore[tr[1]] + vScore[tr[2]];
+        if(tScore[t] > bestScore){
+            bestScore = tScore[t];
+            best = t;
+        }
+    }
+    
+    std::vector<GLuint> out(nInds), cache, next;
+    cache.reserve(cacheSize + 3);
+    next.reserve(cacheSize + 3);
+    std::size_t cursor = 0; // the fallback when nothing in the cache scores
+    for(std::size_t k=0; k<nTri; ++k){
+        if(best == none){
+            while(emitted[cursor]) ++cursor;
+            best = cursor;
+        }
+        const GLuint tri[] = {inds[3 * best], inds[3 * best + 1], inds[3 * best + 2]};
+        std::copy(tri, tri + 3, out.begin() + 3 * k);
+        emitted[best] = 1;
+        // take the triangle off its vertices' lists
+        for(GLuint v: tri){
+            GLuint *b = adj.data() + start[v], *e = b + remaining[v];
+            std::iter_swap(std::find(b, e, best), e - 1);
+            --remaining[v];
+        }
+        // its vertices go to the front of the cache, the rest shuffle back
+        next.assign(tri, tri + 3);
+        for(GLuint v: cache) if(v != tri[0] && v != tri[1] && v != tri[2]) next.push_back(v);
+        cache.swap(next);
+        for(std::size_t i=0; i<cache.size(); ++i){
+            cachePos[cache[i]] = i < cacheSize ? int(i) : -1;
+            vScore[cache[i]] = vertexScore(cachePos[cache[i]], remaining[cache[i]], cacheSize);
+        }
+        // rescore the triangles around the cached and just evicted vertices,
+        // the best is next
+        best = none;
+        bestScore = -1.0f;
+        for(GLuint v: cache){
+            for(GLuint j=start[v]; j<start[v] + remaining[v]; ++j){
+                const GLuint t = adj[j];
+                const GLuint *tr = inds + 3 * std::size_t(t);
+                tScore[t] = vScore[tr[0]] + vScore[tr[1]] + vScore[tr[2]];
+                if(tScore[t] > bestScore){
+                    bestScore = tScore[t];
+                    best = t;
+                }
+            }
+        }
+        if(cache.size() > cacheSize) cache.resize(cacheSize);
+    }
+    std::copy(out.begin(), out.end(), inds);
+}
+
+void vcache::fetchReorder(GLfloat *verts, GLuint stride, GLuint *inds, std::size_t nInds, std::size_t nVerts)
+{
+    const GLuint none = ~0u;
+    std::vector<GLuint> remap(nVerts, none);
+    GLuint cnt = 0;
+    
+    for(std::size_t i=0; i<nInds; ++i){
+        GLuint &r = remap[inds[i]];
+        if(r == none) r = cnt++;
+        inds[i] = r;
+    }
+    // vertices no triangle uses go to the end
+    for(auto &r: remap) if(r == none) r = cnt++;
+    std::vector<GLfloat> old(verts, verts + stride * nVerts);
+    for(std::size_t v=0; v<nVerts; ++v)
+        std::copy(old.begin() + stride * v, old.begin() + stride * (v + 1), verts + stride * std::size_t(remap[v]));
+}
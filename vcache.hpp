@@ -0,0 +1,28 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef vcacheDec
+#define vcacheDec
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
+// Post-transform vertex cache optimisation of an index buffer, Tom Forsyth's
+// linear-speed algorithm, and the matching vertex fetch reordering.
+namespace vcache
+{
+    const GLuint defaultCache = 32;
+    
+    // acmr, average cache miss ratio, misses per triangle, 0.5 is ideal
+    // atvr, average transformed vertex ratio, misses per vertex, 1 is ideal
+    struct stats { double acmr, atvr; };
+    
+    stats measure(bufView<GLuint> inds, std::size_t nVerts, GLuint cacheSize = defaultCache); // FIFO cache
+    void optimize(GLuint *inds, std::size_t nInds, std::size_t nVerts, GLuint cacheSize = defaultCache);
+    // renumbers vertices in order of first use, stride is in floats
+    void fetchReorder(GLfloat *verts, GLuint stride, GLuint *inds, std::size_t nInds, std::size_t nVerts);
+}
+
+#endif
@@ -0,0 +1,205 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include "vertFormat.hpp"
+
+static const GLfloat snormMax = 32767.0f;
+
+std::size_t vertFormat::stride(vertLayout layout)
+{
+    switch(layout){
+        case vertLayout::pos: return 3 * sizeof(GLfloat);
+        case vertLayout::posNorm: return 6 * sizeof(GLfloat);
+        case vertLayout::oct16: return 2 * sizeof(GLshort);
+        case vertLayout::half: return 4 * sizeof(GLushort);
+        case vertLayout::procedural: return 0;
+    }
+    throw std::runtime_error("Error: vertFormat::stride(), unknown layout");
+}
+
+std::size_t vertFormat::floats(vertLayout layout)
+{
+    return layout == vertLayout::posNorm ? 6 : 3;
+}
+
+const char* vertFormat::name(vertLayout layout)
+{
+    switch(layout){
+        case vertLayout::pos: return "pos";
+        case vertLayout::posNorm: return "posNorm";
+        case vertLayout::oct16: return "oct16";
+        case vertLayout::half: return "half";
+        case vertLayout::procedural: return "procedural";
+    }
+    return "unknown";
+}
+
+// IEEE half precision, rounded to nearest even, the sphere needs no infinities
+static GLushort toHalf(GLfloat f)
+{
+    std::uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const std::uint32_t sign = (x >> 16) & 0x8000;
+    const int e = int((x >> 23) & 0xff) - 127 + 15;
+    std::uint32_t m = x & 0x7fffff;
+    if(e >= 31) return sign | 0x7c00;
+    int shift = 13;
+    std::uint32_t h = (std::uint32_t(e) << 10) | (m >> 13);
+    if(e <= 0){ // subnormal
+        if(e < -10) return sign;
+        m |= 0x800000;
+        shift = 14 - e;
+        h = m >> shift;
+    }
+    const std::uint32_t rem = m & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    if(rem > halfway || (rem == halfway && (h & 1))) ++h; // a carry into the exponent is correct
+    return sign | h;
+}
+
+static GLfloat fromHalf(GLushort h)
+{
+    const int e = (h >> 10) & 0x1f;
+    const std::uint32_t m = h & 0x3ff;
+    const GLfloat s = (h & 0x8000) ? -1.0f : 1.0f;
+    if(e == 0) return s * std::ldexp(GLfloat(m), -24);
+    if(e == 31) return s * INFINITY;
+    return s * std::ldexp(GLfloat(m | 0x400), e - 25);
+}
+
+static double signNotZero(double v)
+{
+    return v < 0.0 ? -1.0 : 1.0;
+}
+
+// the decoding in vertex.shader, the integers are read unnormalised so the
+// scaling does not depend on the GL version's rule for signed normalised data
+static void octDecode(const GLshort *c, double *v)
+{
+    const double x = std::max(c[0] / double(snormMax), -1.0), y = std::max(c[1] / double(snormMax), -1.0);
+    v[0] = x;
+    v[1] = y;
+    v[2] = 1.0 - std::abs(x) - std::abs(y);
+    if(v[2] < 0.0){
+        v[0] = (1.0 - std::abs(y)) * signNotZero(x);
+        v[1] = (1.0 - std::abs(x)) * signNotZero(y);
+    }
+    const double len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for(int k=0; k<3; ++k) v[k] /= len;
+}
+
+// the direction is projected onto the octahedron, the lower half folded over
+// the upper, then of the four codes around it the one decoding closest wins
+static void octEncode(const GLfloat *p, GLshort *out)
+{
+    const double l1 = std::abs(p[0]) + std::abs(p[1]) + std::abs(p[2]);
+    double u = p[0] / l1, v = p[1] / l1;
+    if(p[2] < 0.0f){
+        const double fu = (1.0 - std::abs(v)) * signNotZero(u), fv = (1.0 - std::abs(u)) * signNotZero(v);
+        u = fu;
+        v = fv;
+    }
+    const double len = std::sqrt(double(p[0]) * p[0] + double(p[1]) * p[1] + double(p[2]) * p[2]);
+    double best = -2.0;
+    for(int i=0; i<2; ++i){
+        for(int j=0; j<2; ++j){
+            const GLshort c[2] = {GLshort(std::clamp(std::floor(u * snormMax) + i, -double(snormMax), double(snormMax))),
+                                  GLshort(std::clamp(std::floor(v * snormMax) + j, -double(snormMax), double(snormMax)))};
+            double d[3];
+            octDecode(c, d);
+            const double cosine = (d[0] * p[0] + d[1] * p[1] + d[2] * p[2]) / len;
+            if(cosine > best){
+                best = cosine;
+                out[0] = c[0];
+                out[1] = c[1];
+            }
+        }
+    }
+}
+
+void vertFormat::encode(vertLayout layout, const GLfloat *in, std::size_t n, void *out)
+{
+    switch(layout){
+        case vertLayout::pos:
+        case vertLayout::posNorm:
+            std::memcpy(out, in, n * stride(layout));
+            return;
+        case vertLayout::oct16: {
+            GLshort *o = static_cast<GLshort*>(out);
+            for(std::size_t i=0; i<n; ++i) octEncode(in + 3 * i, o + 2 * i);
+            return;
+        }
+        case vertLayout::half: {
+            GLushort *o = static_cast<GLushort*>(out);
+            for(std::size_t i=0; i<n; ++i, o+=4){
+                for(int k=0; k<3; ++k) o[k] = toHalf(in[3 * i + k]);
+                o[3] = 0;
+            }
+            return;
+        }
+        case vertLayout::procedural:
+            break;
+    }
+    throw std::runtime_error("Error: vertFormat::encode(), the procedural layout has no vertices");
+}
+
+// posNorm gives its normals, the others the direction the normal is taken
+// from, normalised as the shader does for the compact formats
+void vertFormat::decode(vertLayout layout, const void *in, std::size_t n, GLfloat *xyz)
+{
+    for(std::size_t i=0; i<n; ++i, xyz+=3){
+        double v[3] = {};
+        switch(layout){
+            case vertLayout::pos:
+                std::memcpy(xyz, static_cast<const GLfloat*>(in) + 3 * i, 3 * sizeof(GLfloat));
+                continue;
+            case vertLayout::posNorm:
+                std::memcpy(xyz, static_cast<const GLfloat*>(in) + 6 * i + 3, 3 * sizeof(GLfloat));
+                continue;
+            case vertLayout::oct16:
+                octDecode(static_cast<const GLshort*>(in) + 2 * i, v);
+                break;
+            case vertLayout::half: {
+                const GLushort *h = static_cast<const GLushort*>(in) + 4 * i;
+                for(int k=0; k<3; ++k) v[k] = fromHalf(h[k]);
+                const double len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+                for(int k=0; k<3; ++k) v[k] /= len;
+                break;
+            }
+            case vertLayout::procedural:
+                throw std::runtime_error("Error: vertFormat::decode(), the procedural layout has no vertices");
+        }
+        for(int k=0; k<3; ++k) xyz[k] = GLfloat(v[k]);
+    }
+}
+
+// encoded and decoded a batch at a time, the angle is found in double
+// precision from the cosine and the sine so small angles keep their digits
+double vertFormat::maxAngle(vertLayout layout, bufView<GLfloat> verts)
+{
+    const std::size_t batch = 4096, nf = floats(layout), n = verts.size() / nf;
+    std::vector<unsigned char> enc(batch * stride(layout));
+    std::vector<GLfloat> dec(3 * batch);
+    double worst = 0.0;
+    for(std::size_t i=0; i<n; i+=batch){
+        const std::size_t m = std::min(batch, n - i);
+        encode(layout, verts.data() + nf * i, m, enc.data());
+        decode(layout, enc.data(), m, dec.data());
+        for(std::size_t j=0; j<m; ++j){
+            const GLfloat *a = verts.data() + nf * (i + j), *b = dec.data() + 3 * j;
+            const double cx = double(a[1]) * b[2] - double(a[2]) * b[1], cy = double(a[2]) * b[0] - double(a[0]) * b[2];
+            const double cz = double(a[0]) * b[1] - double(a[1]) * b[0];
+            const double dot = double(a[0]) * b[0] + double(a[1]) * b[1] + double(a[2]) * b[2];
+            worst = std::max(worst, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot));
+        }
+    }
+    return worst * 180.0 / 3.14159265358979323846;
+}
@@ -0,0 +1,34 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef vertFormatDec
+#define vertFormatDec
+
+#ifndef bufViewDec
+#include "bufView.hpp"
+#endif
+
+// The vertex formats of each vertLayout as they sit in a GL buffer. On the
+// unit sphere the normal is the position, so the compact formats store only
+// a direction and the shader takes the normal from it:
+//   pos     3 floats, 12 bytes
+//   posNorm 6 floats, 24 bytes
+//   oct16   the octahedral map of the direction as 2 16 bit integers, 4 bytes
+//   half    3 half floats and one of padding, 8 bytes
+// Vertices are handed in as floats, xyz then the normal for posNorm and
+// xyz alone for the others. procedural has no vertex buffer, its stride is 0
+// and it cannot be encoded.
+namespace vertFormat
+{
+    std::size_t stride(vertLayout layout); // bytes per vertex in the buffer
+    std::size_t floats(vertLayout layout); // floats per vertex handed in
+    const char* name(vertLayout layout);
+    void encode(vertLayout layout, const GLfloat *in, std::size_t n, void *out); // n vertices
+    void decode(vertLayout layout, const void *in, std::size_t n, GLfloat *xyz); // the positions as the shader makes them
+
+    // the largest angle, in degrees, between a vertex and its decoded direction
+    double maxAngle(vertLayout layout, bufView<GLfloat> xyz);
+}
+
+#endif
@@ -1,21 +1,107 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+// the vertex layout is picked by a #define which oglWrap puts after the
+// #version line, with none the position is 3 floats and is also the normal,
+// with TESS the corners of the patches are passed to tessControl.shader
+#if defined(PROCEDURAL)
+out vec3 UnitPos; // captured by transform feedback to check against the builder
+#elif defined(OCT16)
+layout (location = 0) in ivec2 aOct; // octahedral map of the direction, 16 bits each
+#else
+layout (location = 0) in vec3 aPos; // floats or, with HALF_FLOAT, half floats
+#endif
+#ifdef POS_NORM
 layout (location = 1) in vec3 aNormal;
+#endif
+layout (location = 2) in vec4 aPlace; // per instance, translation then scale
+layout (location = 3) in vec3 aColor; // per instance
+#ifdef TESS
+out vec3 vPos;
+out vec4 vPlace;
+out vec3 vColor;
+#else
 out vec3 Normal;
 out vec3 FragPos;
+flat out vec3 Color;
+#endif
 
-uniform mat4 rotate; 
-uniform mat4 perspective;
 float dz = -5.0;
 vec4 position;
 
+#ifdef OCT16
+float signNotZero(float v)
+{
+    return v < 0.0 ? -1.0 : 1.0;
+}
+
+// the lower half of the sphere is folded over the upper half of the octahedron
+vec3 octDecode(ivec2 c)
+{
+    vec2 e = max(vec2(c) / 32767.0, vec2(-1.0));
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * vec2(signNotZero(v.x), signNotZero(v.y));
+    return normalize(v);
+}
+#endif
+
+#ifdef PROCEDURAL
+// the octahedron as the builder makes it, the upper and lower faces are wound
+// oppositely just as there
+const vec3 corners[6] = vec3[6](vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0), vec3(1.0, 0.0, 0.0),
+                                vec3(0.0, 1.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, -1.0, 0.0));
+const ivec3 faces[8] = ivec3[8](ivec3(2, 3, 0), ivec3(3, 4, 0), ivec3(4, 5, 0), ivec3(5, 2, 0),
+                                ivec3(2, 3, 1), ivec3(3, 4, 1), ivec3(4, 5, 1), ivec3(5, 2, 1));
+
+// gl_VertexID is 3 times the triangle plus the corner, and the triangle's
+// bits are its face then, two at a time from the top, which of the four
+// children it is at each level. Each level's midpoints are the sum of the
+// two ends normalised, exactly as the builder makes them, so a vertex
+// comes out the same from every triangle it is in and there are no cracks
+vec3 procedural(int id)
+{
+    int tri = id / 3, corner = id - 3 * tri;
+    ivec3 f = faces[tri >> (2 * sphereOrder)];
+    vec3 a = corners[f.x], b = corners[f.y], c = corners[f.z];
+    for(int l=sphereOrder-1; l>=0; --l){
+        int child = (tri >> (2 * l)) & 3;
+        vec3 ab = normalize(a + b), bc = normalize(b + c), ca = normalize(c + a);
+        if(child == 0){ b = ab; c = ca; }
+        else if(child == 1){ a = ab; c = bc; }
+        else if(child == 2){ a = ca; b = bc; }
+        else { a = ca; b = bc; c = ab; } // the builder turns the middle one over
+    }
+    return corner == 0 ? a : (corner == 1 ? b : c);
+}
+#endif
+
 void main()
 {    
-    position = rotate * vec4(aPos, 1.0);
+#if defined(PROCEDURAL)
+    vec3 pos = procedural(gl_VertexID);
+    UnitPos = pos;
+#elif defined(OCT16)
+    vec3 pos = octDecode(aOct);
+#elif defined(HALF_FLOAT)
+    vec3 pos = normalize(aPos); // back onto the unit sphere
+#else
+    vec3 pos = aPos;
+#endif
+#ifdef POS_NORM
+    vec3 normal = aNormal;
+#else
+    vec3 normal = pos; // the same on a unit sphere
+#endif
+#ifdef TESS
+    vPos = pos; // placed once tessellated
+    vPlace = aPlace;
+    vColor = aColor;
+#else
+    position = rotate * vec4(aPlace.w * pos, 1.0);
+    position.xyz += aPlace.xyz; // place this instance
     position.z += dz; // move the whole sphere
     gl_Position = perspective * position; // predefined vertex output position
-    Normal = vec3(rotate * vec4(aNormal, 0.0)); 
+    Normal = vec3(rotate * vec4(normal, 0.0)); 
     FragPos = vec3(position); // real position for lighting calculations
+    Color = aColor;
+#endif
 }
 
-
@@ -0,0 +1,87 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include "workPool.hpp"
+
+workPool::workPool(GLuint n):nWorkers(n > 0 ? n : 1)
+{
+    threads.reserve(nWorkers - 1);
+    for(GLuint t=1; t<nWorkers; ++t) threads.emplace_back(&workPool::worker, this, t);
+}
+
+workPool::~workPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    cvStart.notify_all();
+    for(auto &th: threads) th.join();
+}
+
+// every worker runs job once, returns when they have all finished
+// the first exception thrown by any worker is rethrown here
+void workPool::run(const std::function<void(GLuint)> &job)
+{
+    if(nWorkers == 1){
+        job(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        current = &job;
+        pending = nWorkers - 1;
+        error = nullptr;
+        ++generation;
+    }
+    cvStart.notify_all();
+    try{
+        job(0);
+    }
+    catch(...){
+        std::lock_guard<std::mutex> lock(mtx);
+        if(!error) error = std::current_exception();
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    cvDone.wait(lock, [this]{ return pending == 0; });
+    current = nullptr;
+    if(error) std::rethrow_exception(error);
+}
+
+void workPool::worker(GLuint t)
+{
+    GLuint64 seen = 0;
+    
+    for(;;){
+        const std::function<void(GLuint)> *job;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cvStart.wait(lock, [this, seen]{ return quit || generation != seen; });
+            if(quit) return;
+            seen = generation;
+            job = current;
+        }
+        std::exception_ptr err;
+        try{
+            (*job)(t);
+        }
+        catch(...){
+            err = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(err && !error) error = err;
+            --pending;
+        }
+        cvDone.notify_one();
+    }
+}
@@ -0,0 +1,32 @@
+// OpenGL Involute gear simulation
+// Stephen R Williams, Feb 2019
+// License: GPL-3.0
+
+#ifndef workPoolDec
+#define workPoolDec
+
+// a fixed set of worker threads which all run the same job, the calling
+// thread acts as worker 0 so a pool of size 1 starts no threads at all
+class workPool
+{
+public:
+    workPool(GLuint n);
+    ~workPool();
+    GLuint size(){ return nWorkers; }
+    void run(const std::function<void(GLuint)> &job); // job(t) for t in [0, size()), then wait 
+private:
+    void worker(GLuint t);
+    
+    // private data
+    const GLuint nWorkers;
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cvStart, cvDone;
+    const std::function<void(GLuint)> *current = nullptr;
+    GLuint64 generation = 0;
+    GLuint pending = 0;
+    std::exception_ptr error;
+    bool quit = false;
+};
+
+#endif